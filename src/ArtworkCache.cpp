@@ -0,0 +1,417 @@
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "ArtworkCache.h"
+#include "BackendRequest.h"
+#include "client.h"
+#include "md5.h"
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <stdio.h>
+
+using namespace ADDON;
+
+#define HTTP_OK 200
+#define HTTP_NOTFOUND 404
+
+#define ARTWORK_MANIFEST "manifest.txt"
+#define ARTWORK_MANIFEST_HEADER "nextpvr artwork 1"
+
+namespace NextPVR
+{
+  ArtworkCache::ArtworkCache(void)
+  {
+    m_maxBytes = 0;
+    m_totalBytes = 0;
+    m_dirty = false;
+    m_hits = 0;
+    m_misses = 0;
+    m_fetchedBytes = 0;
+  }
+
+  ArtworkCache::~ArtworkCache()
+  {
+    Close();
+  }
+
+  std::string ArtworkCache::LocalPath(const std::string &path)
+  {
+    char *localPath = XBMC->TranslateSpecialProtocol(path.c_str());
+    std::string result = localPath;
+    XBMC->FreeString(localPath);
+    return result;
+  }
+
+  void ArtworkCache::Open(const std::string &directory, int64_t maxBytes)
+  {
+    Close();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (maxBytes <= 0)
+      return;
+    m_directory = directory;
+    m_maxBytes = maxBytes;
+    XBMC->CreateDirectory(m_directory.c_str());
+    Load();
+  }
+
+  void ArtworkCache::Close()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_dirty)
+      Save();
+    m_directory.clear();
+    m_keys.clear();
+    m_images.clear();
+    m_queue.clear();
+    m_queuedKeys.clear();
+    m_failures.clear();
+    m_totalBytes = 0;
+  }
+
+  bool ArtworkCache::Load()
+  {
+    FILE *file = fopen(LocalPath(m_directory + ARTWORK_MANIFEST).c_str(), "r");
+    if (file == nullptr)
+      return false;
+
+    // a line per image: i, MD5, size, time last used and file type,
+    // and a line per key: k, key, MD5 or nothing and time fetched
+    char line[1024];
+    bool ok = fgets(line, sizeof(line), file) != nullptr && strncmp(line, ARTWORK_MANIFEST_HEADER "\n", sizeof(line)) == 0;
+    while (ok && fgets(line, sizeof(line), file) != nullptr)
+    {
+      std::vector<std::string> fields;
+      char *field = line;
+      for (char *c = line; ; c++)
+      {
+        if (*c == '\t' || *c == '\n' || *c == '\0')
+        {
+          fields.push_back(std::string(field, c - field));
+          if (*c != '\t')
+            break;
+          field = c + 1;
+        }
+      }
+      if (fields.size() == 5 && fields[0] == "i")
+      {
+        image entry;
+        entry.size = atoll(fields[2].c_str());
+        entry.lastUsed = (time_t) atoll(fields[3].c_str());
+        entry.extension = fields[4];
+        m_images[fields[1]] = entry;
+        m_totalBytes += entry.size;
+      }
+      else if (fields.size() == 4 && fields[0] == "k")
+      {
+        keyEntry entry;
+        entry.hash = fields[2];
+        entry.checked = (time_t) atoll(fields[3].c_str());
+        m_keys[fields[1]] = entry;
+      }
+    }
+    fclose(file);
+    if (!ok)
+    {
+      XBMC->Log(LOG_NOTICE, "%s:%d: ignoring %s%s", __FUNCTION__, __LINE__, m_directory.c_str(), ARTWORK_MANIFEST);
+      m_images.clear();
+      m_keys.clear();
+      m_totalBytes = 0;
+    }
+    XBMC->Log(LOG_DEBUG, "%s:%d: %d images, %d keys, %lld KB", __FUNCTION__, __LINE__, (int) m_images.size(), (int) m_keys.size(), (long long) (m_totalBytes / 1024));
+    return ok;
+  }
+
+  void ArtworkCache::Save()
+  {
+    std::string path = LocalPath(m_directory + ARTWORK_MANIFEST);
+    std::string tempPath = path + ".tmp";
+    FILE *file = fopen(tempPath.c_str(), "w");
+    if (file == nullptr)
+    {
+      XBMC->Log(LOG_ERROR, "%s:%d: cannot write %s", __FUNCTION__, __LINE__, tempPath.c_str());
+      return;
+    }
+    time_t now = time(nullptr);
+    bool ok = fputs(ARTWORK_MANIFEST_HEADER "\n", file) >= 0;
+    for (const std::pair<const std::string, image> &entry : m_images)
+    {
+      ok = ok && fprintf(file, "i\t%s\t%lld\t%lld\t%s\n", entry.first.c_str(), (long long) entry.second.size, (long long) entry.second.lastUsed, entry.second.extension.c_str()) > 0;
+    }
+    for (const std::pair<const std::string, keyEntry> &entry : m_keys)
+    {
+      // keys of removed images and missing artwork due to be asked for again are dropped
+      if (entry.second.hash.empty() ? now - entry.second.checked > ARTWORK_MISSING_RETRY : m_images.find(entry.second.hash) == m_images.end())
+        continue;
+      ok = ok && fprintf(file, "k\t%s\t%s\t%lld\n", entry.first.c_str(), entry.second.hash.c_str(), (long long) entry.second.checked) > 0;
+    }
+    ok = fclose(file) == 0 && ok;
+#if defined(TARGET_WINDOWS)
+    remove(path.c_str());
+#endif
+    if (!ok || rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+      XBMC->Log(LOG_ERROR, "%s:%d: cannot save %s", __FUNCTION__, __LINE__, path.c_str());
+      remove(tempPath.c_str());
+      return;
+    }
+    m_dirty = false;
+  }
+
+  std::string ArtworkCache::ImagePath(const std::string &hash, const image &file) const
+  {
+    return m_directory + hash + "." + file.extension;
+  }
+
+  std::string ArtworkCache::GetPath(const std::string &key, const std::string &resource, const std::string &url)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_directory.empty())
+      return url;
+
+    time_t now = time(nullptr);
+    std::map<std::string, keyEntry>::iterator it = m_keys.find(key);
+    if (it != m_keys.end())
+    {
+      if (it->second.hash.empty())
+      {
+        if (now - it->second.checked <= ARTWORK_MISSING_RETRY)
+        {
+          m_hits++;
+          return "";
+        }
+      }
+      else
+      {
+        std::map<std::string, image>::iterator file = m_images.find(it->second.hash);
+        if (file != m_images.end())
+        {
+          // the manifest is not written for every use
+          if (now - file->second.lastUsed > 60)
+          {
+            file->second.lastUsed = now;
+            m_dirty = true;
+          }
+          m_hits++;
+          return ImagePath(file->first, file->second);
+        }
+      }
+      m_keys.erase(it);
+    }
+
+    m_misses++;
+    if (m_queue.size() < ARTWORK_MAX_QUEUE && m_queuedKeys.insert(key).second)
+    {
+      queued request;
+      request.key = key;
+      request.resource = resource;
+      m_queue.push_back(request);
+    }
+    return url;
+  }
+
+  bool ArtworkCache::Identify(const std::string &path, std::string &hash, image &file)
+  {
+    FILE *input = fopen(LocalPath(path).c_str(), "rb");
+    if (input == nullptr)
+      return false;
+    PVRXBMC::XBMC_MD5 md5;
+    unsigned char magic[4] = { 0, 0, 0, 0 };
+    std::vector<char> buffer(65536);
+    int64_t size = 0;
+    size_t length;
+    while ((length = fread(buffer.data(), 1, buffer.size(), input)) > 0)
+    {
+      if (size == 0)
+        memcpy(magic, buffer.data(), std::min(length, sizeof(magic)));
+      md5.append(buffer.data(), length);
+      size += length;
+    }
+    fclose(input);
+    if (size == 0)
+      return false;
+    md5.getDigest(hash);
+    file.size = size;
+    file.lastUsed = time(nullptr);
+    // Kodi picks the image decoder by file type
+    if (magic[0] == 0x89 && magic[1] == 'P' && magic[2] == 'N' && magic[3] == 'G')
+      file.extension = "png";
+    else if (magic[0] == 'G' && magic[1] == 'I' && magic[2] == 'F')
+      file.extension = "gif";
+    else
+      file.extension = "jpg";
+    return true;
+  }
+
+  void ArtworkCache::Prefetch(const std::function<bool()> &stopping)
+  {
+    struct result
+    {
+      queued request;
+      std::string tempPath;
+      bool fetched;
+      bool missing;
+      std::string hash;
+      image file;
+    };
+    std::vector<result> results;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (m_directory.empty())
+        return;
+      while (!m_queue.empty() && results.size() < ARTWORK_PREFETCH_BATCH)
+      {
+        result entry;
+        entry.request = m_queue.front();
+        entry.tempPath = m_directory + "fetch-" + std::to_string(results.size()) + ".tmp";
+        entry.fetched = false;
+        entry.missing = false;
+        results.push_back(entry);
+        m_queue.pop_front();
+      }
+      if (results.empty())
+      {
+        if (m_dirty)
+          Save();
+        return;
+      }
+    }
+
+    // the copies run on the backend's bulk workers, which also hash them
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::mutex mutex;
+    std::condition_variable finished;
+    int pending = 0;
+    size_t started = 0;
+    for (result &entry : results)
+    {
+      if (stopping())
+        break;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        pending++;
+      }
+      started++;
+      result *current = &entry;
+      m_backEnd->FileCopyAsync(entry.request.resource.c_str(), entry.tempPath, HttpClient::validator(), [&, current](int resultCode, int64_t, const HttpClient::validator &)
+      {
+        bool fetched = resultCode == HTTP_OK && Identify(current->tempPath, current->hash, current->file);
+        std::unique_lock<std::mutex> lock(mutex);
+        current->fetched = fetched;
+        // anything but an image or a not found, such as a timeout, is asked for again
+        current->missing = resultCode == HTTP_NOTFOUND || (resultCode == HTTP_OK && !fetched);
+        pending--;
+        finished.notify_one();
+      });
+    }
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      finished.wait(lock, [&pending]() { return pending == 0; });
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // closed while fetching
+    if (m_directory.empty())
+      return;
+    // the images not asked for are queued again when they are next looked up
+    for (size_t i = started; i < results.size(); i++)
+    {
+      m_queuedKeys.erase(results[i].request.key);
+    }
+    results.erase(results.begin() + started, results.end());
+    time_t now = time(nullptr);
+    int added = 0;
+    int duplicates = 0;
+    int missing = 0;
+    int failed = 0;
+    int64_t bytes = 0;
+    for (result &entry : results)
+    {
+      m_queuedKeys.erase(entry.request.key);
+      keyEntry key;
+      key.checked = now;
+      if (entry.fetched)
+      {
+        bytes += entry.file.size;
+        key.hash = entry.hash;
+        if (m_images.find(entry.hash) != m_images.end())
+        {
+          duplicates++;
+          remove(LocalPath(entry.tempPath).c_str());
+        }
+        else if (rename(LocalPath(entry.tempPath).c_str(), LocalPath(ImagePath(entry.hash, entry.file)).c_str()) == 0)
+        {
+          added++;
+          m_images[entry.hash] = entry.file;
+          m_totalBytes += entry.file.size;
+        }
+        else
+        {
+          key.hash.clear();
+          remove(LocalPath(entry.tempPath).c_str());
+        }
+      }
+      else
+      {
+        remove(LocalPath(entry.tempPath).c_str());
+        if (!entry.missing && ++m_failures[entry.request.key] < ARTWORK_MAX_FAILURES)
+        {
+          failed++;
+          continue;
+        }
+        missing++;
+      }
+      m_failures.erase(entry.request.key);
+      m_keys[entry.request.key] = key;
+    }
+    m_fetchedBytes += bytes;
+    Evict();
+    Save();
+    XBMC->Log(LOG_DEBUG, "%s:%d: %d images, %d new, %d held already, %d missing, %d failed, %lld bytes in %d ms; %d hits, %d misses, %lld bytes fetched in all, %lld KB held", __FUNCTION__, __LINE__,
+      (int) results.size(), added, duplicates, missing, failed, (long long) bytes,
+      (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(),
+      m_hits, m_misses, (long long) m_fetchedBytes, (long long) (m_totalBytes / 1024));
+  }
+
+  void ArtworkCache::Evict()
+  {
+    if (m_totalBytes <= m_maxBytes)
+      return;
+    std::vector<std::pair<time_t, std::string>> byUse;
+    for (const std::pair<const std::string, image> &entry : m_images)
+    {
+      byUse.push_back(std::make_pair(entry.second.lastUsed, entry.first));
+    }
+    std::sort(byUse.begin(), byUse.end());
+    int evicted = 0;
+    // the keys of an image removed are dropped when they are looked up next
+    for (size_t i = 0; i < byUse.size() && m_totalBytes > m_maxBytes; i++)
+    {
+      std::map<std::string, image>::iterator file = m_images.find(byUse[i].second);
+      remove(LocalPath(ImagePath(file->first, file->second)).c_str());
+      m_totalBytes -= file->second.size;
+      m_images.erase(file);
+      evicted++;
+    }
+    XBMC->Log(LOG_DEBUG, "%s:%d: %d images removed, %lld KB held", __FUNCTION__, __LINE__, evicted, (long long) (m_totalBytes / 1024));
+  }
+}
@@ -0,0 +1,122 @@
+#pragma once
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <ctime>
+#include <string>
+#include <deque>
+#include <set>
+#include <map>
+#include <mutex>
+#include <functional>
+#include <stdint.h>
+
+namespace NextPVR
+{
+
+#define ARTWORK_PREFETCH_BATCH 32 // images fetched per Prefetch, on the backend's bulk workers
+#define ARTWORK_MAX_QUEUE 512 // images waiting to be fetched, more are asked for again later
+#define ARTWORK_MISSING_RETRY 3600 // sec before artwork the backend did not have is asked for again
+#define ARTWORK_MAX_FAILURES 3 // failed fetches in a row before artwork is taken as missing
+
+  /**
+   * Local copies of guide and recording artwork. Images are found by a
+   * stable key such as the event or recording id and stored once per
+   * content, named by their MD5, so their paths stay the same across
+   * sessions and Kodi's texture cache keeps working. The least recently
+   * used images are removed once the cache outgrows its size.
+   */
+  class ArtworkCache
+  {
+    public:
+      ArtworkCache(void);
+      virtual ~ArtworkCache();
+
+      /**
+       * Uses directory for the images and their manifest
+       * @param maxBytes size the images are kept under
+       */
+      void Open(const std::string &directory, int64_t maxBytes);
+      void Close();
+
+      /**
+       * @return the local copy of the artwork stored under key. Until it
+       * is fetched from resource url is returned, and an empty path once
+       * the backend turned out to have none.
+       */
+      std::string GetPath(const std::string &key, const std::string &resource, const std::string &url);
+
+      /**
+       * Fetches up to ARTWORK_PREFETCH_BATCH queued images and saves the
+       * manifest when it changed
+       * @param stopping tells to leave the rest of the batch, for unloading
+       */
+      void Prefetch(const std::function<bool()> &stopping);
+
+    private:
+      struct image
+      {
+        int64_t size;
+        time_t lastUsed;
+        std::string extension;
+      };
+
+      struct keyEntry
+      {
+        std::string hash;  // empty when the backend has no artwork
+        time_t checked;
+      };
+
+      struct queued
+      {
+        std::string key;
+        std::string resource;
+      };
+
+      bool Load();
+      void Save();
+      void Evict();
+      std::string ImagePath(const std::string &hash, const image &file) const;
+
+      /**
+       * Reads a downloaded image for the MD5 and file type of its content
+       * @return false when the file cannot be read
+       */
+      static bool Identify(const std::string &path, std::string &hash, image &file);
+      static std::string LocalPath(const std::string &path);
+
+      std::mutex m_mutex;
+      std::string m_directory;
+      int64_t m_maxBytes;
+      int64_t m_totalBytes;
+      bool m_dirty;
+      std::map<std::string, keyEntry> m_keys;
+      std::map<std::string, image> m_images;
+      std::deque<queued> m_queue;
+      std::set<std::string> m_queuedKeys;
+      // failed fetches in a row by key, a copy through Kodi cannot tell a
+      // missing image from a timeout
+      std::map<std::string, int> m_failures;
+      int m_hits;
+      int m_misses;
+      int64_t m_fetchedBytes;
+  };
+}
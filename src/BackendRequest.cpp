@@ -21,90 +21,513 @@
 
 #include  "BackendRequest.h"
 #include "Filesystem.h"
+#include <algorithm>
+#include <chrono>
 
 #define HTTP_OK 200
 #define HTTP_NOTFOUND 404
 #define HTTP_BADREQUEST 400
+#define HTTP_NOT_MODIFIED 304
+
+#define REQUEST_BULK_PLAYING 1      // bulk calls in flight while a stream is playing
+#define REQUEST_STATS_INTERVAL 100
+#define RESPONSE_STATUS_WINDOW 512  // the status element comes right after the xml declaration
 
 using namespace ADDON;
 
 namespace NextPVR
 {
   Request *m_backEnd;
+
+  // calls in flight per request class
+  static const int requestClassLimits[RequestClassCount] = { 2, 2, 2 };
+  static const char *requestClassNames[RequestClassCount] = { "playback", "interactive", "bulk" };
+
+  // calls the stream depends on, everything else that is not bulk is interactive
+  static const char *playbackMethods[] = { "method=channel.transcode.", "method=channel.stream.", "method=recording.edl" };
+  static const char *bulkMethods[] = { "method=channel.listings", "method=channel.icon", "method=recording.list&filter=all", "method=recording.list&filter=ready" };
+
+  // methods that only read from the backend, safe to pipeline and to repeat
+  static const char *idempotentMethods[] = { ".list", ".listings", ".groups", ".info", ".lastupdated" };
+
+  static bool IsIdempotent(const std::string &resource)
+  {
+    size_t start = resource.find("method=");
+    if (start == std::string::npos)
+      return false;
+    std::string method = resource.substr(start, resource.find('&', start) - start);
+    for (const char *suffix : idempotentMethods)
+    {
+      size_t length = strlen(suffix);
+      if (method.size() >= length && method.compare(method.size() - length, length, suffix) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  // the part of the method before the first dot, recording for recording.save
+  static std::string MethodFamily(const std::string &resource)
+  {
+    size_t start = resource.find("method=");
+    if (start == std::string::npos)
+      return "";
+    start += strlen("method=");
+    return resource.substr(start, resource.find_first_of(".&", start) - start);
+  }
+
+  Request::Request(void)
+  {
+    if (!XBMC->GetSetting("keepalive", &m_keepAlive))
+    {
+      m_keepAlive = false;
+    }
+    if (!XBMC->GetSetting("responsecache", &m_responseCache))
+    {
+      m_responseCache = false;
+    }
+    memset(m_classes, 0, sizeof(m_classes));
+    m_requests = 0;
+    m_deduplicated = 0;
+
+    int workers;
+    if (!XBMC->GetSetting("requestworkers", &workers))
+    {
+      workers = 2;
+    }
+    m_workers.Start(workers);
+  }
+
+  Request::~Request()
+  {
+    m_workers.Stop();
+    if (m_requests > 0)
+      LogStats();
+  }
+
+  void Request::setSID(const char *newsid)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_sid = newsid;
+  }
+
+  std::string Request::getSID()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_sid;
+  }
+
+  eRequestClass Request::Classify(const std::string &resource)
+  {
+    for (const char *method : playbackMethods)
+    {
+      if (resource.find(method) != std::string::npos)
+        return RequestPlayback;
+    }
+    for (const char *method : bulkMethods)
+    {
+      if (resource.find(method) != std::string::npos)
+        return RequestBulk;
+    }
+    return RequestInteractive;
+  }
+
+  bool Request::CanStart(eRequestClass requestClass) const
+  {
+    if (m_classes[requestClass].inFlight >= requestClassLimits[requestClass])
+      return false;
+    if (requestClass == RequestBulk && g_NowPlaying != NotPlaying)
+    {
+      // keep bulk work out of the way of the stream
+      return m_classes[RequestBulk].inFlight < REQUEST_BULK_PLAYING && m_classes[RequestPlayback].inFlight == 0;
+    }
+    return true;
+  }
+
+  int Request::AcquireSlot(eRequestClass requestClass)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_slotFree.wait(lock, [this, requestClass]()
+    {
+      return CanStart(requestClass);
+    });
+    classStats &stats = m_classes[requestClass];
+    stats.inFlight++;
+    stats.maxInFlight = std::max(stats.maxInFlight, stats.inFlight);
+    int waitMs = (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    stats.requests++;
+    m_requests++;
+    if (waitMs > 0)
+    {
+      stats.waited++;
+      stats.waitMs += waitMs;
+      stats.maxWaitMs = std::max(stats.maxWaitMs, waitMs);
+    }
+    return waitMs;
+  }
+
+  void Request::ReleaseSlot(eRequestClass requestClass)
+  {
+    bool logStats;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_classes[requestClass].inFlight--;
+      // waiters of every class share the condition
+      m_slotFree.notify_all();
+      logStats = m_requests % REQUEST_STATS_INTERVAL == 0;
+    }
+    if (logStats)
+      LogStats();
+  }
+
+  void Request::LogStats()
+  {
+    if (m_responseCache)
+      m_cache.LogStats();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (int i = 0; i < RequestClassCount; i++)
+    {
+      const classStats &stats = m_classes[i];
+      XBMC->Log(LOG_DEBUG, "%s:%d: %s: %d requests, at most %d in flight, %d waited for a slot, avg wait %d max %d ms", __FUNCTION__, __LINE__,
+        requestClassNames[i], stats.requests, stats.maxInFlight, stats.waited, stats.waited > 0 ? (int) (stats.waitMs / stats.waited) : 0, stats.maxWaitMs);
+    }
+    XBMC->Log(LOG_DEBUG, "%s:%d: %d requests shared a call already in flight", __FUNCTION__, __LINE__, m_deduplicated);
+  }
+
+  int Request::CheckResponse(const char *resource, std::string &response)
+  {
+    static const std::string statusOk = "<rsp stat=\"ok\">";
+    // only the head of the response is searched, not a multi-megabyte body
+    std::string::const_iterator head = response.begin() + std::min(response.size(), (size_t) RESPONSE_STATUS_WINDOW);
+    if (std::search(response.cbegin(), head, statusOk.begin(), statusOk.end()) == head && strstr(resource, "method=channel.stream.info") == NULL )
+    {
+      XBMC->Log(LOG_ERROR, "DoRequest failed, response=%s", response.c_str());
+      return HTTP_BADREQUEST;
+    }
+    return HTTP_OK;
+  }
+
+  void Request::InvalidateCache(const std::string &method)
+  {
+    if (m_responseCache)
+      m_cache.Invalidate(method);
+  }
+
   int Request::DoRequest(const char *resource, std::string &response)
   {
-    P8PLATFORM::CLockObject lock(m_mutexRequest);
-    m_start = time(nullptr);
+    if (!IsIdempotent(resource))
+      return Fetch(resource, response);
+
+    std::shared_ptr<flight> current;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      std::map<std::string, std::shared_ptr<flight>>::iterator it = m_flights.find(resource);
+      if (it != m_flights.end())
+      {
+        // the same call is in flight, wait for its response
+        current = it->second;
+        current->waiters++;
+        m_deduplicated++;
+        XBMC->Log(LOG_DEBUG, "DoRequest shared %s", resource);
+        m_flightDone.wait(lock, [&current]()
+        {
+          return current->done;
+        });
+        response = current->response;
+        return current->resultCode;
+      }
+      current = std::make_shared<flight>();
+      current->done = false;
+      current->waiters = 0;
+      current->resultCode = HTTP_NOTFOUND;
+      m_flights[resource] = current;
+    }
+
+    int resultCode = Fetch(resource, response);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    current->resultCode = resultCode;
+    if (current->waiters > 0)
+      current->response = response;
+    current->done = true;
+    m_flights.erase(resource);
+    m_flightDone.notify_all();
+    return resultCode;
+  }
+
+  std::future<int> Request::DoRequestAsync(const char *resource, std::string &response)
+  {
+    std::string path = resource;
+    // std::function needs a copyable task, so the promise is shared
+    std::shared_ptr<std::promise<int>> result = std::make_shared<std::promise<int>>();
+    std::future<int> resultCode = result->get_future();
+    m_workers.Submit([this, path, &response, result]()
+    {
+      result->set_value(DoRequest(path.c_str(), response));
+    });
+    return resultCode;
+  }
+
+  void Request::DoRequestAsync(const char *resource, const std::function<void(int, const std::string &)> &callback)
+  {
+    std::string path = resource;
+    m_workers.Submit([this, path, callback]()
+    {
+      std::string response;
+      int resultCode = DoRequest(path.c_str(), response);
+      callback(resultCode, response);
+    });
+  }
+
+  std::future<int> Request::FileCopyAsync(const char *resource, const std::string &fileName)
+  {
+    std::string path = resource;
+    std::shared_ptr<std::promise<int>> result = std::make_shared<std::promise<int>>();
+    std::future<int> resultCode = result->get_future();
+    m_workers.Submit([this, path, fileName, result]()
+    {
+      result->set_value(FileCopy(path.c_str(), fileName));
+    });
+    return resultCode;
+  }
+
+  void Request::FileCopyAsync(const char *resource, const std::string &fileName, const HttpClient::validator &cacheValidator,
+    const std::function<void(int, int64_t, const HttpClient::validator &)> &callback)
+  {
+    std::string path = resource;
+    m_workers.Submit([this, path, fileName, cacheValidator, callback]()
+    {
+      HttpClient::validator responseValidator = cacheValidator;
+      int64_t written = 0;
+      int resultCode = FileCopy(path.c_str(), fileName, responseValidator, written);
+      callback(resultCode, written, responseValidator);
+    });
+  }
+
+  int Request::Fetch(const char *resource, std::string &response)
+  {
+    bool cacheable = m_responseCache && ResponseCache::TimeToLive(resource) > 0;
+    bool cached = false;
+    bool fresh = false;
+    std::string cachedResponse;
+    HttpClient::validator cacheValidator;
+    if (cacheable)
+    {
+      cached = m_cache.Get(resource, cachedResponse, cacheValidator, fresh);
+      if (cached && fresh)
+      {
+        response.swap(cachedResponse);
+        XBMC->Log(LOG_DEBUG, "DoRequest cached %s %d", resource, response.length());
+        return HTTP_OK;
+      }
+    }
+
+    eRequestClass requestClass = Classify(resource);
+    int waitMs = AcquireSlot(requestClass);
+    time_t start = time(nullptr);
     // build request string, adding SID if requred
-    char strURL[1024];
+    char strPath[1024];
 
     if (strstr(resource, "method=session") == NULL)
-      snprintf(strURL,sizeof(strURL),"http://%s:%d%s&sid=%s", g_szHostname.c_str(), g_iPort, resource, m_sid);
+      snprintf(strPath,sizeof(strPath),"%s&sid=%s", resource, getSID().c_str());
     else
-      snprintf(strURL,sizeof(strURL),"http://%s:%d%s", g_szHostname.c_str(), g_iPort, resource);
+      snprintf(strPath,sizeof(strPath),"%s", resource);
 
-    // ask XBMC to read the URL for us
     int resultCode = HTTP_NOTFOUND;
-    void* fileHandle = XBMC->OpenFile(strURL, READ_NO_CACHE);
-    if (fileHandle)
+    int status = 0;
+    // a call that changes something is not sent twice
+    if (m_keepAlive && m_httpClient.Get(strPath, status, response, HTTP_CONNECT_TIMEOUT, cacheValidator, IsIdempotent(resource)))
     {
-      char buffer[1024];
-      while (XBMC->ReadFileString(fileHandle, buffer, 1024))
+      if (status == HTTP_NOT_MODIFIED && cached)
       {
-        response.append(buffer);
+        response.swap(cachedResponse);
+        m_cache.Refresh(resource, cacheValidator);
+        resultCode = HTTP_OK;
       }
-      XBMC->CloseFile(fileHandle);
-      resultCode = HTTP_OK;
-      if ((response.empty() || strstr(response.c_str(), "<rsp stat=\"ok\">") == NULL) && strstr(resource, "method=channel.stream.info") == NULL )
+      else if (status == HTTP_OK)
       {
-        XBMC->Log(LOG_ERROR, "DoRequest failed, response=%s", response.c_str());
-        resultCode = HTTP_BADREQUEST;
+        resultCode = CheckResponse(resource, response);
+      }
+    }
+    else
+    {
+      cacheValidator = HttpClient::validator();
+      // ask XBMC to read the URL for us
+      char strURL[1024];
+      snprintf(strURL,sizeof(strURL),"http://%s:%d%s", g_szHostname.c_str(), g_iPort, strPath);
+      response.clear();
+      void* fileHandle = XBMC->OpenFile(strURL, READ_NO_CACHE);
+      if (fileHandle)
+      {
+        // read in large blocks straight into the response, sized up front when the length is known
+        int64_t length = XBMC->GetFileLength(fileHandle);
+        if (length > 0)
+          response.reserve(length + 1);
+        while (true)
+        {
+          // one byte past a known length is enough to see the end
+          size_t used = response.size();
+          size_t block = HTTP_BLOCK_SIZE;
+          if (length > 0 && used <= (size_t) length)
+            block = std::min(block, (size_t) length + 1 - used);
+          response.resize(used + block);
+          ssize_t dataRead = XBMC->ReadFile(fileHandle, &response[used], block);
+          response.resize(used + (dataRead > 0 ? dataRead : 0));
+          if (dataRead <= 0)
+            break;
+        }
+        XBMC->CloseFile(fileHandle);
+        resultCode = CheckResponse(resource, response);
       }
     }
-    XBMC->Log(LOG_DEBUG, "DoRequest return %s %d %d %d", resource, resultCode,response.length(),time(nullptr) -m_start);
+    ReleaseSlot(requestClass);
+    if (resultCode == HTTP_OK && status != HTTP_NOT_MODIFIED)
+    {
+      if (cacheable)
+        m_cache.Put(resource, response, cacheValidator);
+      else if (m_responseCache && strstr(resource, "method=session") == NULL && !IsIdempotent(resource))
+        m_cache.Invalidate(MethodFamily(resource) + ".");
+    }
+    XBMC->Log(LOG_DEBUG, "DoRequest return %s %d %d %d wait %d", resource, resultCode,response.length(),time(nullptr) - start, waitMs);
 
     return resultCode;
   }
+  void Request::DoRequests(const std::vector<std::string> &resources, std::vector<std::string> &responses, std::vector<int> &resultCodes)
+  {
+    resultCodes.assign(resources.size(), HTTP_NOTFOUND);
+    // cached calls take the single request path, where the cache is
+    bool anyCacheable = m_responseCache && std::any_of(resources.begin(), resources.end(), [](const std::string &resource)
+    {
+      return ResponseCache::TimeToLive(resource) > 0;
+    });
+    if (m_keepAlive && !anyCacheable && resources.size() > 1 && std::all_of(resources.begin(), resources.end(), IsIdempotent))
+    {
+      // the batch runs in the most urgent class of its calls
+      eRequestClass requestClass = RequestBulk;
+      for (const std::string &resource : resources)
+      {
+        requestClass = std::min(requestClass, Classify(resource));
+      }
+      int waitMs = AcquireSlot(requestClass);
+      time_t start = time(nullptr);
+      std::string sid = getSID();
+      std::vector<std::string> paths;
+      for (const std::string &resource : resources)
+      {
+        paths.push_back(resource + "&sid=" + sid);
+      }
+      std::vector<int> status;
+      bool pipelined = m_httpClient.GetPipelined(paths, status, responses);
+      ReleaseSlot(requestClass);
+      if (pipelined)
+      {
+        for (size_t i = 0; i < resources.size(); i++)
+        {
+          if (status[i] == HTTP_OK)
+            resultCodes[i] = CheckResponse(resources[i].c_str(), responses[i]);
+          XBMC->Log(LOG_DEBUG, "DoRequests return %s %d %d %d wait %d", resources[i].c_str(), resultCodes[i], responses[i].length(), time(nullptr) - start, waitMs);
+        }
+        return;
+      }
+    }
+    responses.assign(resources.size(), std::string());
+    for (size_t i = 0; i < resources.size(); i++)
+    {
+      resultCodes[i] = DoRequest(resources[i].c_str(), responses[i]);
+    }
+  }
   int Request::FileCopy(const char *resource,std::string fileName)
   {
-    P8PLATFORM::CLockObject lock(m_mutexRequest);
-    int written = 0;
-    m_start = time(nullptr);
+    HttpClient::validator cacheValidator;
+    int64_t written;
+    return FileCopy(resource, fileName, cacheValidator, written);
+  }
 
-    char strURL[1024];
+  int Request::FileCopy(const char *resource, const std::string &fileName, HttpClient::validator &cacheValidator, int64_t &written)
+  {
+    // file copies are icons and stream lists, nothing playback waits for
+    int waitMs = AcquireSlot(RequestBulk);
+    written = 0;
+    time_t start = time(nullptr);
+
+    char strPath[1024];
     char separator = (strchr(resource,'?') == nullptr) ?  '?' : '&';
-    snprintf(strURL,sizeof(strURL),"http://%s:%d%s%csid=%s", g_szHostname.c_str(), g_iPort, resource, separator, m_sid);
+    snprintf(strPath,sizeof(strPath),"%s%csid=%s", resource, separator, getSID().c_str());
 
-    // ask XBMC to read the URL for us
-    int resultCode = HTTP_NOTFOUND;
-    void* inputFile = XBMC->OpenFile(strURL, READ_NO_CACHE);
-    int datalen;
-    if (inputFile)
+    int resultCode = HTTP_BADREQUEST;
+    int status;
+    std::string body;
+    // file copies only read
+    if (m_keepAlive && m_httpClient.Get(strPath, status, body, HTTP_CONNECT_TIMEOUT, cacheValidator, true))
     {
-      void* outputFile = XBMC->OpenFileForWrite(fileName.c_str(), true);
-      if (outputFile)
+      if (status == HTTP_NOT_MODIFIED)
+      {
+        resultCode = HTTP_NOT_MODIFIED;
+      }
+      else if (status != HTTP_OK)
       {
-        char buffer[1024];
-        while ((datalen=XBMC->ReadFile(inputFile, buffer, sizeof(buffer))))
+        // a not found tells the backend has no such file
+        resultCode = status;
+      }
+      else if (body.empty())
+      {
+        resultCode = HTTP_NOTFOUND;
+      }
+      else
+      {
+        // the whole body in one write
+        void* outputFile = XBMC->OpenFileForWrite(fileName.c_str(), true);
+        if (outputFile)
         {
-          XBMC->WriteFile(outputFile, buffer, datalen);
-          written += datalen;
+          written = XBMC->WriteFile(outputFile, body.c_str(), body.size());
+          XBMC->CloseFile(outputFile);
+          resultCode = HTTP_OK;
+        }
+      }
+    }
+    else
+    {
+      cacheValidator = HttpClient::validator();
+      // ask XBMC to read the URL for us
+      char strURL[1024];
+      snprintf(strURL,sizeof(strURL),"http://%s:%d%s", g_szHostname.c_str(), g_iPort, strPath);
+      void* inputFile = XBMC->OpenFile(strURL, READ_NO_CACHE);
+      int datalen;
+      if (inputFile)
+      {
+        void* outputFile = XBMC->OpenFileForWrite(fileName.c_str(), true);
+        if (outputFile)
+        {
+          std::vector<char> buffer(HTTP_BLOCK_SIZE);
+          while ((datalen=XBMC->ReadFile(inputFile, buffer.data(), buffer.size())) > 0)
+          {
+            XBMC->WriteFile(outputFile, buffer.data(), datalen);
+            written += datalen;
+          }
+          XBMC->CloseFile(outputFile);
+          // an empty body is a missing file, as on a kept alive connection
+          resultCode = written > 0 ? HTTP_OK : HTTP_NOTFOUND;
         }
         XBMC->CloseFile(inputFile);
-        XBMC->CloseFile(outputFile);
-        resultCode = HTTP_OK;
       }
     }
-    if (written == 0)
+    if (written == 0 && resultCode == HTTP_OK)
     {
       resultCode = HTTP_BADREQUEST;
     }
-    XBMC->Log(LOG_DEBUG, "FileCopy (%s - %s) %d %d %d", resource, fileName.c_str(), resultCode,written,time(nullptr) -m_start);
+    ReleaseSlot(RequestBulk);
+    XBMC->Log(LOG_DEBUG, "FileCopy (%s - %s) %d %lld %d wait %d", resource, fileName.c_str(), resultCode, written, time(nullptr) - start, waitMs);
 
     return resultCode;
   }
   bool Request::PingBackend()
   {
+    if (m_keepAlive)
+    {
+      int status;
+      std::string response;
+      return m_httpClient.Get("/service?method=recording.lastupdated", status, response, 2, true) && status == HTTP_OK;
+    }
     char strURL[1024];
     snprintf(strURL,sizeof(strURL),"http://%s:%d%s|connection-timeout=2", g_szHostname.c_str(), g_iPort, "/service?method=recording.lastupdated");
     void* fileHandle = XBMC->OpenFile(strURL, READ_NO_CACHE);
@@ -115,4 +538,4 @@ namespace NextPVR
     }
     return false;
   }
-}
\ No newline at end of file
+}
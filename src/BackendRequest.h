@@ -22,28 +22,139 @@
 #include <ctime>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
 
 #include "client.h"
-#include "p8-platform/threads/mutex.h"
+#include "HttpClient.h"
+#include "ResponseCache.h"
+#include "WorkerPool.h"
 
 using namespace ADDON;
 
 namespace NextPVR
 {
+  /**
+   * Scheduling class of a backend call. Each class has its own limit on
+   * calls in flight, so bulk fetches cannot hold up calls playback needs.
+   */
+  enum eRequestClass
+  {
+    RequestPlayback = 0,
+    RequestInteractive = 1,
+    RequestBulk = 2,
+    RequestClassCount = 3
+  };
+
   class Request
   {
     public:
+      /**
+       * Calls the backend. A call that only reads and is already in flight
+       * from another thread is not sent again, its response is shared.
+       */
       int DoRequest(const char *resource, std::string &response);
+
+      /**
+       * Runs several requests, pipelined on one connection when all of them
+       * only read from the backend
+       */
+      void DoRequests(const std::vector<std::string> &resources, std::vector<std::string> &responses, std::vector<int> &resultCodes);
+
+      /**
+       * Runs DoRequest on a worker thread, response must stay valid until
+       * the result is taken from the future
+       */
+      std::future<int> DoRequestAsync(const char *resource, std::string &response);
+
+      /**
+       * Runs DoRequest on a worker thread and hands the result to callback there
+       */
+      void DoRequestAsync(const char *resource, const std::function<void(int, const std::string &)> &callback);
       int FileCopy(const char *resource, std::string fileName);
-      void setSID(char *newsid) {strcpy(m_sid,newsid);};
+
+      /**
+       * Copies resource to fileName unless cacheValidator shows the copy
+       * held is still current, cacheValidator is replaced by the one of
+       * the response
+       * @param written set to the bytes written
+       * @return HTTP_OK when copied, 304 when the copy held is current,
+       * 404 or another backend status when it has no such file, 400 when
+       * the copy failed
+       */
+      int FileCopy(const char *resource, const std::string &fileName, HttpClient::validator &cacheValidator, int64_t &written);
+      std::future<int> FileCopyAsync(const char *resource, const std::string &fileName);
+
+      /**
+       * Runs the conditional FileCopy on a worker thread and hands the
+       * result, bytes written and new validator to callback there
+       */
+      void FileCopyAsync(const char *resource, const std::string &fileName, const HttpClient::validator &cacheValidator,
+        const std::function<void(int, int64_t, const HttpClient::validator &)> &callback);
+
+      /**
+       * Drops cached responses of methods starting with method, all of them
+       * when it is empty
+       */
+      void InvalidateCache(const std::string &method);
+      void setSID(const char *newsid);
       bool PingBackend();
-      const char *getSID() {return m_sid;};
-      Request(void){};
-      virtual ~Request() {};
+      std::string getSID();
+      Request(void);
+      virtual ~Request();
     private:
-      P8PLATFORM::CMutex        m_mutexRequest;
-      time_t m_start;
-      char m_sid[64];
+      int Fetch(const char *resource, std::string &response);
+      int CheckResponse(const char *resource, std::string &response);
+
+      struct flight
+      {
+        bool done;
+        int waiters;
+        int resultCode;
+        std::string response;
+      };
+
+      struct classStats
+      {
+        int inFlight;
+        int maxInFlight;
+        int requests;
+        int waited;
+        int64_t waitMs;
+        int maxWaitMs;
+      };
+
+      static eRequestClass Classify(const std::string &resource);
+
+      /**
+       * Waits for a slot of the request class
+       * @return the time waited in ms
+       */
+      int AcquireSlot(eRequestClass requestClass);
+      void ReleaseSlot(eRequestClass requestClass);
+      bool CanStart(eRequestClass requestClass) const;
+      void LogStats();
+
+      HttpClient m_httpClient;
+      bool m_keepAlive;
+      ResponseCache m_cache;
+      bool m_responseCache;
+      std::mutex m_mutex;
+      std::condition_variable m_slotFree;
+      std::string m_sid;
+      classStats m_classes[RequestClassCount];
+      int m_requests;
+      std::condition_variable m_flightDone;
+      std::map<std::string, std::shared_ptr<flight>> m_flights;
+      int m_deduplicated;
+      // last, so the workers end before anything they use
+      WorkerPool m_workers;
   };
   extern Request *m_backEnd;
 }
\ No newline at end of file
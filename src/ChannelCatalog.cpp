@@ -0,0 +1,306 @@
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "ChannelCatalog.h"
+#include "BackendRequest.h"
+#include "XmlReader.h"
+#include "client.h"
+#include <chrono>
+#include <cstring>
+
+using namespace ADDON;
+
+#define HTTP_OK 200
+
+// defined in pvrclient-nextpvr.cpp
+std::string UriEncode(const std::string sSrc);
+
+namespace NextPVR
+{
+  ChannelCatalog::ChannelCatalog(void)
+  {
+    m_loaded = 0;
+    m_text.assign(1, '\0');
+    m_streamText.assign(1, '\0');
+  }
+
+  bool ChannelCatalog::Update()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_loaded != 0 && time(nullptr) - m_loaded <= CHANNEL_CATALOG_MAX_AGE)
+      return true;
+    if (Load())
+      m_loaded = time(nullptr);
+    return !m_channels.empty();
+  }
+
+  void ChannelCatalog::Invalidate()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_loaded = 0;
+  }
+
+  bool ChannelCatalog::Load()
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::string> resources;
+    resources.push_back("/service?method=channel.list");
+    resources.push_back("/service?method=channel.groups");
+    std::vector<std::string> responses;
+    std::vector<int> resultCodes;
+    m_backEnd->DoRequests(resources, responses, resultCodes);
+    if (resultCodes[0] != HTTP_OK)
+      return false;
+
+    // built aside, a failed load keeps the catalog held
+    std::vector<catalogChannel> channels;
+    std::unordered_map<int, int> index;
+    std::vector<catalogGroup> groups;
+    std::vector<catalogMember> members;
+    std::string names(1, '\0');
+    std::string text;
+    XmlReader channelReader(responses[0]);
+    while (channelReader.Find("channel"))
+    {
+      catalogChannel channel;
+      memset(&channel, 0, sizeof(channel));
+      int depth = channelReader.Depth();
+      while (channelReader.NextChild(depth))
+      {
+        const XmlView &name = channelReader.Name();
+        if (name.Equals("id"))
+          channel.id = channelReader.ReadText().ToInt();
+        else if (name.Equals("number"))
+          channel.number = channelReader.ReadText().ToInt();
+        else if (name.Equals("minor"))
+          channel.minor = channelReader.ReadText().ToInt();
+        else if (name.Equals("type"))
+          channel.isRadio = channelReader.ReadText().Equals("0xa");
+        else if (name.Equals("name"))
+        {
+          channelReader.ReadText().TextTo(text);
+          channel.name = AddText(names, text);
+        }
+        else if (name.Equals("icon"))
+        {
+          channel.hasIcon = true;
+          channelReader.Skip();
+        }
+        else
+          channelReader.Skip();
+      }
+      index[channel.id] = (int) channels.size();
+      channels.push_back(channel);
+    }
+
+    std::vector<std::string> memberResources;
+    if (resultCodes[1] == HTTP_OK)
+    {
+      XmlReader groupReader(responses[1]);
+      while (groupReader.Find("group"))
+      {
+        catalogGroup group;
+        group.name = 0;
+        group.firstMember = 0;
+        group.memberCount = 0;
+        int depth = groupReader.Depth();
+        while (groupReader.NextChild(depth))
+        {
+          if (groupReader.Name().Equals("name"))
+          {
+            groupReader.ReadText().TextTo(text);
+            group.name = AddText(names, text);
+          }
+          else
+            groupReader.Skip();
+        }
+        // Kodi has its own group of all channels, the backend's is not passed on
+        if (strcmp(names.c_str() + group.name, "All Channels") != 0)
+          memberResources.push_back("/service?method=channel.list&group_id=" + UriEncode(names.c_str() + group.name));
+        groups.push_back(group);
+      }
+    }
+
+    // there is no call for the members of all groups, their lists share one batch
+    std::vector<std::string> memberResponses;
+    std::vector<int> memberResultCodes;
+    if (!memberResources.empty())
+      m_backEnd->DoRequests(memberResources, memberResponses, memberResultCodes);
+    size_t listed = 0;
+    for (catalogGroup &group : groups)
+    {
+      if (strcmp(names.c_str() + group.name, "All Channels") == 0)
+        continue;
+      size_t response = listed++;
+      group.firstMember = (int) members.size();
+      if (memberResultCodes[response] != HTTP_OK)
+        continue;
+      XmlReader memberReader(memberResponses[response]);
+      while (memberReader.Find("channel"))
+      {
+        catalogMember member;
+        member.channelId = 0;
+        member.number = 0;
+        int depth = memberReader.Depth();
+        while (memberReader.NextChild(depth))
+        {
+          if (memberReader.Name().Equals("id"))
+            member.channelId = memberReader.ReadText().ToInt();
+          else if (memberReader.Name().Equals("number"))
+            member.number = memberReader.ReadText().ToInt();
+          else
+            memberReader.Skip();
+        }
+        members.push_back(member);
+      }
+      group.memberCount = (int) members.size() - group.firstMember;
+    }
+
+    m_channels.swap(channels);
+    m_index.swap(index);
+    m_groups.swap(groups);
+    m_members.swap(members);
+    m_text.swap(names);
+    ApplyLiveStreams();
+    XBMC->Log(LOG_DEBUG, "%s:%d: %d channels, %d groups, %d members loaded in %d ms", __FUNCTION__, __LINE__, (int) m_channels.size(), (int) m_groups.size(), (int) m_members.size(),
+      (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+    return true;
+  }
+
+  uint32_t ChannelCatalog::AddText(std::string &buffer, const std::string &text)
+  {
+    if (text.empty())
+      return 0;
+    uint32_t offset = (uint32_t) buffer.size();
+    buffer.append(text.c_str(), text.size() + 1);
+    return offset;
+  }
+
+  void ChannelCatalog::ApplyLiveStreams()
+  {
+    m_streamText.assign(1, '\0');
+    for (catalogChannel &channel : m_channels)
+    {
+      std::map<int, std::string>::const_iterator it = m_liveStreams.find(channel.id);
+      channel.stream = it != m_liveStreams.end() ? AddText(m_streamText, it->second) : 0;
+      channel.isPlugin = it != m_liveStreams.end() && it->second.compare(0, 7, "plugin:") == 0;
+    }
+  }
+
+  void ChannelCatalog::SetLiveStreams(const std::map<int, std::string> &liveStreams)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_liveStreams = liveStreams;
+    ApplyLiveStreams();
+  }
+
+  const catalogChannel *ChannelCatalog::Find(int channelId) const
+  {
+    std::unordered_map<int, int>::const_iterator it = m_index.find(channelId);
+    if (it == m_index.end())
+      return nullptr;
+    return &m_channels[it->second];
+  }
+
+  int ChannelCatalog::ChannelCount()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return (int) m_channels.size();
+  }
+
+  int ChannelCatalog::GroupCount()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return (int) m_groups.size();
+  }
+
+  void ChannelCatalog::VisitChannels(bool radio, const std::function<void(const catalogChannel &, const char *name)> &visit)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (const catalogChannel &channel : m_channels)
+    {
+      if (channel.isRadio == radio)
+        visit(channel, m_text.c_str() + channel.name);
+    }
+  }
+
+  void ChannelCatalog::VisitGroups(const std::function<void(const char *name)> &visit)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (const catalogGroup &group : m_groups)
+    {
+      visit(m_text.c_str() + group.name);
+    }
+  }
+
+  void ChannelCatalog::VisitMembers(const std::string &groupName, const std::function<void(int channelId, int number)> &visit)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (const catalogGroup &group : m_groups)
+    {
+      if (groupName != m_text.c_str() + group.name)
+        continue;
+      for (int i = group.firstMember; i < group.firstMember + group.memberCount; i++)
+      {
+        visit(m_members[i].channelId, m_members[i].number);
+      }
+      break;
+    }
+  }
+
+  bool ChannelCatalog::IsRadio(int channelId, bool &isRadio)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const catalogChannel *channel = Find(channelId);
+    if (channel == nullptr)
+      return false;
+    isRadio = channel->isRadio;
+    return true;
+  }
+
+  bool ChannelCatalog::IsPlugin(int channelId)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const catalogChannel *channel = Find(channelId);
+    return channel != nullptr && channel->isPlugin;
+  }
+
+  std::string ChannelCatalog::GetLiveStream(int channelId)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const catalogChannel *channel = Find(channelId);
+    if (channel == nullptr)
+      return "";
+    return m_streamText.c_str() + channel->stream;
+  }
+
+  std::vector<int> ChannelCatalog::GetChannelIds()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::vector<int> channelIds;
+    channelIds.reserve(m_channels.size());
+    for (const catalogChannel &channel : m_channels)
+    {
+      channelIds.push_back(channel.id);
+    }
+    return channelIds;
+  }
+}
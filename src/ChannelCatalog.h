@@ -0,0 +1,139 @@
+#pragma once
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <functional>
+#include <ctime>
+#include <stdint.h>
+
+namespace NextPVR
+{
+
+#define CHANNEL_CATALOG_MAX_AGE 60 // sec a load serves the channel and group calls
+
+  /**
+   * Channel of the catalog. Its name and live stream are offsets into the
+   * catalog's name and stream text, 0 being the empty string.
+   */
+  struct catalogChannel
+  {
+    int id;
+    int number;
+    int minor;
+    bool isRadio;
+    bool hasIcon;
+    bool isPlugin;
+    uint32_t name;
+    uint32_t stream;
+  };
+
+  /**
+   * All channels, channel groups and group members of the backend, loaded
+   * at once and kept for CHANNEL_CATALOG_MAX_AGE. The channels are one
+   * array in backend order with a hash from channel id to position.
+   */
+  class ChannelCatalog
+  {
+    public:
+      ChannelCatalog(void);
+      virtual ~ChannelCatalog() {};
+
+      /**
+       * Loads the catalog again when it is older than CHANNEL_CATALOG_MAX_AGE.
+       * The channels and groups come in one pipelined batch, the members of
+       * all groups in a second one.
+       * @return false when there is no catalog
+       */
+      bool Update();
+
+      /**
+       * Has the next Update load the catalog again
+       */
+      void Invalidate();
+
+      /**
+       * Live stream URLs from LiveStreams.xml by channel id
+       */
+      void SetLiveStreams(const std::map<int, std::string> &liveStreams);
+
+      int ChannelCount();
+      int GroupCount();
+
+      /**
+       * Hands the TV or radio channels to visit in backend order, the text
+       * is only valid during the call
+       */
+      void VisitChannels(bool radio, const std::function<void(const catalogChannel &, const char *name)> &visit);
+      void VisitGroups(const std::function<void(const char *name)> &visit);
+
+      /**
+       * Hands the channel id and number of each member of groupName to visit
+       */
+      void VisitMembers(const std::string &groupName, const std::function<void(int channelId, int number)> &visit);
+
+      /**
+       * @return false when channelId is not in the catalog
+       */
+      bool IsRadio(int channelId, bool &isRadio);
+      bool IsPlugin(int channelId);
+
+      /**
+       * @return the live stream URL of channelId, empty when it has none
+       */
+      std::string GetLiveStream(int channelId);
+      std::vector<int> GetChannelIds();
+
+    private:
+      struct catalogGroup
+      {
+        uint32_t name;
+        int firstMember;
+        int memberCount;
+      };
+
+      struct catalogMember
+      {
+        int channelId;
+        int number;
+      };
+
+      bool Load();
+      void ApplyLiveStreams();
+      static uint32_t AddText(std::string &buffer, const std::string &text);
+      const catalogChannel *Find(int channelId) const;
+
+      std::mutex m_mutex;
+      time_t m_loaded;
+      std::vector<catalogChannel> m_channels;
+      std::unordered_map<int, int> m_index;
+      std::vector<catalogGroup> m_groups;
+      std::vector<catalogMember> m_members;
+      std::string m_text;
+      // rebuilt whole with the live streams
+      std::string m_streamText;
+      std::map<int, std::string> m_liveStreams;
+  };
+}
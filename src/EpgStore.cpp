@@ -0,0 +1,720 @@
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdio.h>
+
+#include "EpgStore.h"
+#include "client.h"
+
+#if !defined(TARGET_WINDOWS)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define EPG_CACHE_MAGIC 0x4745504e  // "NPEG"
+#define EPG_CACHE_VERSION 2
+
+using namespace ADDON;
+
+namespace NextPVR
+{
+  EpgListings::EpgListings(void)
+  {
+    m_block = nullptr;
+    m_blockUsed = EPG_TEXT_BLOCK_SIZE;
+    m_textBytes = 0;
+    m_internHits = 0;
+  }
+
+  size_t EpgListings::textHash::operator()(const textKey &key) const
+  {
+    // FNV-1a
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < key.length; i++)
+    {
+      hash = (hash ^ (unsigned char) key.text[i]) * 16777619u;
+    }
+    return hash;
+  }
+
+  bool EpgListings::textEqual::operator()(const textKey &a, const textKey &b) const
+  {
+    return a.length == b.length && memcmp(a.text, b.text, a.length) == 0;
+  }
+
+  const char *EpgListings::Store(const char *text, size_t length)
+  {
+    size_t size = length + 1;
+    char *stored;
+    if (size > EPG_TEXT_BLOCK_SIZE / 4)
+    {
+      // a long text gets a block of its own, the current one stays in use
+      m_blocks.push_back(std::unique_ptr<char[]>(new char[size]));
+      stored = m_blocks.back().get();
+    }
+    else
+    {
+      if (m_blockUsed + size > EPG_TEXT_BLOCK_SIZE)
+      {
+        m_blocks.push_back(std::unique_ptr<char[]>(new char[EPG_TEXT_BLOCK_SIZE]));
+        m_block = m_blocks.back().get();
+        m_blockUsed = 0;
+      }
+      stored = m_block + m_blockUsed;
+      m_blockUsed += size;
+    }
+    memcpy(stored, text, length);
+    stored[length] = '\0';
+    m_textBytes += size;
+    return stored;
+  }
+
+  const char *EpgListings::Intern(const char *text)
+  {
+    if (*text == '\0')
+      return "";
+    textKey key;
+    key.text = text;
+    key.length = strlen(text);
+    std::unordered_set<textKey, textHash, textEqual>::const_iterator it = m_interned.find(key);
+    if (it != m_interned.end())
+    {
+      m_internHits++;
+      return it->text;
+    }
+    key.text = Store(text, key.length);
+    m_interned.insert(key);
+    return key.text;
+  }
+
+  void EpgListings::Add(const epgEntry &entry)
+  {
+    epgEntry added = entry;
+    added.title = Intern(entry.title);
+    added.subtitle = Intern(entry.subtitle);
+    added.description = *entry.description == '\0' ? "" : Store(entry.description, strlen(entry.description));
+    added.genre = Intern(entry.genre);
+    m_entries.push_back(added);
+  }
+
+  void EpgListings::Sort()
+  {
+    std::sort(m_entries.begin(), m_entries.end(), [](const epgEntry &a, const epgEntry &b)
+    {
+      return a.start < b.start;
+    });
+    // sorting is the last step of filling the listings, drop the spare capacity
+    m_entries.shrink_to_fit();
+  }
+
+  EpgStore::EpgStore(void)
+  {
+    m_guideStart = 0;
+    m_guideEnd = 0;
+    m_guideLoaded = 0;
+    m_refresh = false;
+    m_refreshStart = 0;
+    m_refreshEnd = 0;
+    m_retain = EPG_STORE_MIN_RETAIN;
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_header = nullptr;
+    m_mappedChannels = nullptr;
+    m_mappedShards = nullptr;
+    m_mappedEvents = nullptr;
+    m_strings = nullptr;
+  }
+
+  EpgStore::~EpgStore()
+  {
+    Close();
+  }
+
+  int EpgStore::MaxAge(time_t shardStart)
+  {
+    // the next day changes most, later shards are fetched less often
+    return shardStart < time(nullptr) + 24 * 3600 ? EPG_STORE_MAX_AGE : EPG_STORE_FAR_MAX_AGE;
+  }
+
+  bool EpgStore::Open(const std::string &path)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Unmap();
+    char *nativePath = XBMC->TranslateSpecialProtocol(path.c_str());
+    m_path = nativePath;
+    XBMC->FreeString(nativePath);
+    return Map();
+  }
+
+  void EpgStore::Close()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Unmap();
+    m_path.clear();
+  }
+
+  bool EpgStore::Map()
+  {
+#if defined(TARGET_WINDOWS)
+    FILE *file = fopen(m_path.c_str(), "rb");
+    if (file == nullptr)
+      return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    bool loaded = size >= (long) sizeof(cacheHeader);
+    m_mapCopy.resize(loaded ? size : 0);
+    loaded = loaded && fread(m_mapCopy.data(), size, 1, file) == 1;
+    fclose(file);
+    if (!loaded)
+    {
+      m_mapCopy.clear();
+      return false;
+    }
+    const char *data = m_mapCopy.data();
+    m_mapSize = m_mapCopy.size();
+#else
+    int fd = open(m_path.c_str(), O_RDONLY);
+    if (fd == -1)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(cacheHeader))
+    {
+      close(fd);
+      return false;
+    }
+    // shared with the page cache, only the pages read take up memory
+    m_map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m_map == MAP_FAILED)
+    {
+      m_map = nullptr;
+      return false;
+    }
+    m_mapSize = st.st_size;
+    const char *data = (const char *) m_map;
+#endif
+
+    const cacheHeader *header = (const cacheHeader *) data;
+    size_t channelsOffset = sizeof(cacheHeader);
+    size_t shardsOffset = channelsOffset + (size_t) header->channelCount * sizeof(cacheChannel);
+    size_t eventsOffset = shardsOffset + (size_t) header->shardCount * sizeof(cacheShard);
+    size_t stringsOffset = eventsOffset + (size_t) header->eventCount * sizeof(cacheEvent);
+    bool ok = header->magic == EPG_CACHE_MAGIC && header->version == EPG_CACHE_VERSION
+      && header->channelCount >= 0 && header->shardCount >= 0 && header->eventCount >= 0 && header->stringBytes > 0
+      && stringsOffset + header->stringBytes == m_mapSize && data[m_mapSize - 1] == '\0';
+    if (ok)
+    {
+      m_header = header;
+      m_mappedChannels = (const cacheChannel *) (data + channelsOffset);
+      m_mappedShards = (const cacheShard *) (data + shardsOffset);
+      m_mappedEvents = (const cacheEvent *) (data + eventsOffset);
+      m_strings = data + stringsOffset;
+      for (int i = 0; ok && i < header->channelCount; i++)
+      {
+        const cacheChannel &channel = m_mappedChannels[i];
+        ok = channel.firstShard >= 0 && channel.shardCount >= 0 && channel.firstShard + channel.shardCount <= header->shardCount
+          && (i == 0 || m_mappedChannels[i - 1].channelId < channel.channelId);
+        for (int j = 0; ok && j < channel.shardCount; j++)
+        {
+          const cacheShard &shard = m_mappedShards[channel.firstShard + j];
+          ok = shard.firstEvent >= 0 && shard.eventCount >= 0 && shard.firstEvent + shard.eventCount <= header->eventCount
+            && (j == 0 || m_mappedShards[channel.firstShard + j - 1].start < shard.start);
+        }
+      }
+    }
+    if (!ok)
+    {
+      // written by another version or damaged
+      XBMC->Log(LOG_DEBUG, "%s:%d: unusable guide cache %s", __FUNCTION__, __LINE__, m_path.c_str());
+      Unmap();
+      return false;
+    }
+    XBMC->Log(LOG_DEBUG, "%s:%d: %d channels, %d shards, %d listings in guide cache %s", __FUNCTION__, __LINE__, header->channelCount, header->shardCount, header->eventCount, m_path.c_str());
+    return true;
+  }
+
+  void EpgStore::Unmap()
+  {
+#if !defined(TARGET_WINDOWS)
+    if (m_map != nullptr)
+      munmap(m_map, m_mapSize);
+#endif
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_mapCopy.clear();
+    m_header = nullptr;
+    m_mappedChannels = nullptr;
+    m_mappedShards = nullptr;
+    m_mappedEvents = nullptr;
+    m_strings = nullptr;
+  }
+
+  void EpgStore::Save()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_path.empty() || m_channels.empty())
+      return;
+
+    // channels held in memory replace their saved listings
+    std::vector<int> channelIds = HeldChannels();
+
+    std::vector<cacheChannel> channels;
+    std::vector<cacheShard> shards;
+    std::vector<cacheEvent> events;
+    // offset 0 is the empty string
+    std::string strings(1, '\0');
+    std::map<std::string, uint32_t> stringOffsets;
+    auto intern = [&strings, &stringOffsets](const char *text) -> uint32_t
+    {
+      if (*text == '\0')
+        return 0;
+      std::pair<std::map<std::string, uint32_t>::iterator, bool> added = stringOffsets.insert(std::make_pair(std::string(text), (uint32_t) strings.size()));
+      if (added.second)
+        strings.append(text, strlen(text) + 1);
+      return added.first->second;
+    };
+
+    time_t oldest = OldestShard();
+    for (int channelId : channelIds)
+    {
+      cacheChannel channel;
+      channel.channelId = channelId;
+      channel.firstShard = (int32_t) shards.size();
+      channel.reserved = 0;
+      for (time_t shardStart : Shards(channelId))
+      {
+        if (shardStart < oldest)
+          continue;
+        cacheShard shard;
+        time_t loaded;
+        ShardLoaded(channelId, shardStart, loaded);
+        shard.start = shardStart;
+        shard.loaded = loaded;
+        shard.firstEvent = (int32_t) events.size();
+        VisitShard(channelId, shardStart, 0, std::numeric_limits<time_t>::max(), [&events, &intern](const epgEntry &entry)
+        {
+          cacheEvent event;
+          memset(&event, 0, sizeof(event));
+          event.start = entry.start;
+          event.end = entry.end;
+          event.id = entry.id;
+          event.title = intern(entry.title);
+          event.subtitle = intern(entry.subtitle);
+          event.description = intern(entry.description);
+          event.genre = intern(entry.genre);
+          event.year = entry.year;
+          event.genreType = entry.genreType;
+          event.genreSubtype = entry.genreSubtype;
+          event.season = entry.season;
+          event.episode = entry.episode;
+          events.push_back(event);
+        });
+        shard.eventCount = (int32_t) events.size() - shard.firstEvent;
+        shards.push_back(shard);
+      }
+      channel.shardCount = (int32_t) shards.size() - channel.firstShard;
+      channels.push_back(channel);
+    }
+
+    cacheHeader header;
+    header.magic = EPG_CACHE_MAGIC;
+    header.version = EPG_CACHE_VERSION;
+    header.channelCount = (int32_t) channels.size();
+    header.shardCount = (int32_t) shards.size();
+    header.eventCount = (int32_t) events.size();
+    header.reserved = 0;
+    header.stringBytes = (int64_t) strings.size();
+
+    // written aside and renamed over the old file, which may still be mapped
+    std::string tempPath = m_path + ".tmp";
+    FILE *file = fopen(tempPath.c_str(), "wb");
+    if (file == nullptr)
+    {
+      XBMC->Log(LOG_ERROR, "%s:%d: cannot write %s", __FUNCTION__, __LINE__, tempPath.c_str());
+      return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+      && fwrite(channels.data(), sizeof(cacheChannel), channels.size(), file) == channels.size()
+      && fwrite(shards.data(), sizeof(cacheShard), shards.size(), file) == shards.size()
+      && fwrite(events.data(), sizeof(cacheEvent), events.size(), file) == events.size()
+      && fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+    ok = fclose(file) == 0 && ok;
+#if defined(TARGET_WINDOWS)
+    // the listings mapped are a copy in memory there
+    if (ok)
+      remove(m_path.c_str());
+#endif
+    if (!ok || rename(tempPath.c_str(), m_path.c_str()) != 0)
+    {
+      // the old file stays mapped, the listings it holds are kept
+      XBMC->Log(LOG_ERROR, "%s:%d: cannot save %s", __FUNCTION__, __LINE__, m_path.c_str());
+      remove(tempPath.c_str());
+      return;
+    }
+    Unmap();
+    if (Map())
+      m_channels.clear();
+  }
+
+  const EpgStore::cacheChannel *EpgStore::FindMapped(int channelId) const
+  {
+    if (m_header == nullptr)
+      return nullptr;
+    const cacheChannel *end = m_mappedChannels + m_header->channelCount;
+    const cacheChannel *channel = std::lower_bound(m_mappedChannels, end, channelId, [](const cacheChannel &c, int id)
+    {
+      return c.channelId < id;
+    });
+    if (channel == end || channel->channelId != channelId)
+      return nullptr;
+    return channel;
+  }
+
+  const EpgStore::cacheShard *EpgStore::FindMappedShard(int channelId, time_t shardStart) const
+  {
+    const cacheChannel *channel = FindMapped(channelId);
+    if (channel == nullptr)
+      return nullptr;
+    const cacheShard *first = m_mappedShards + channel->firstShard;
+    const cacheShard *end = first + channel->shardCount;
+    const cacheShard *shard = std::lower_bound(first, end, shardStart, [](const cacheShard &s, time_t start)
+    {
+      return s.start < start;
+    });
+    if (shard == end || shard->start != shardStart)
+      return nullptr;
+    return shard;
+  }
+
+  const char *EpgStore::String(uint32_t offset) const
+  {
+    if (offset >= m_header->stringBytes)
+      return "";
+    return m_strings + offset;
+  }
+
+  void EpgStore::ToEntry(const cacheEvent &event, epgEntry &entry) const
+  {
+    entry.id = event.id;
+    entry.start = (time_t) event.start;
+    entry.end = (time_t) event.end;
+    // the text stays in the mapped string table
+    entry.title = String(event.title);
+    entry.subtitle = String(event.subtitle);
+    entry.description = String(event.description);
+    entry.genre = String(event.genre);
+    entry.year = event.year;
+    entry.genreType = event.genreType;
+    entry.genreSubtype = event.genreSubtype;
+    entry.season = event.season;
+    entry.episode = event.episode;
+  }
+
+  bool EpgStore::HasChannel(int channelId) const
+  {
+    return m_channels.find(channelId) != m_channels.end() || FindMapped(channelId) != nullptr;
+  }
+
+  std::vector<int> EpgStore::HeldChannels() const
+  {
+    std::vector<int> channelIds;
+    for (const std::pair<const int, std::map<time_t, shardListings>> &channel : m_channels)
+    {
+      channelIds.push_back(channel.first);
+    }
+    for (int i = 0; m_header != nullptr && i < m_header->channelCount; i++)
+    {
+      if (m_channels.find(m_mappedChannels[i].channelId) == m_channels.end())
+        channelIds.push_back(m_mappedChannels[i].channelId);
+    }
+    std::sort(channelIds.begin(), channelIds.end());
+    return channelIds;
+  }
+
+  void EpgStore::VisitShards(const std::function<void(int channelId, time_t shardStart, const std::vector<epgEntry> &entries)> &visit)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::vector<epgEntry> entries;
+    for (int channelId : HeldChannels())
+    {
+      for (time_t shardStart : Shards(channelId))
+      {
+        entries.clear();
+        VisitShard(channelId, shardStart, 0, std::numeric_limits<time_t>::max(), [&entries](const epgEntry &entry)
+        {
+          entries.push_back(entry);
+        });
+        visit(channelId, shardStart, entries);
+      }
+    }
+  }
+
+  std::vector<time_t> EpgStore::Shards(int channelId) const
+  {
+    std::vector<time_t> shardStarts;
+    std::map<int, std::map<time_t, shardListings>>::const_iterator it = m_channels.find(channelId);
+    if (it != m_channels.end())
+    {
+      for (const std::pair<const time_t, shardListings> &shard : it->second)
+      {
+        shardStarts.push_back(shard.first);
+      }
+    }
+    const cacheChannel *channel = FindMapped(channelId);
+    if (channel != nullptr)
+    {
+      for (int i = 0; i < channel->shardCount; i++)
+      {
+        shardStarts.push_back((time_t) m_mappedShards[channel->firstShard + i].start);
+      }
+    }
+    std::sort(shardStarts.begin(), shardStarts.end());
+    shardStarts.erase(std::unique(shardStarts.begin(), shardStarts.end()), shardStarts.end());
+    return shardStarts;
+  }
+
+  bool EpgStore::ShardLoaded(int channelId, time_t shardStart, time_t &loaded) const
+  {
+    std::map<int, std::map<time_t, shardListings>>::const_iterator it = m_channels.find(channelId);
+    if (it != m_channels.end())
+    {
+      std::map<time_t, shardListings>::const_iterator shard = it->second.find(shardStart);
+      if (shard != it->second.end())
+      {
+        loaded = shard->second.loaded;
+        return true;
+      }
+    }
+    const cacheShard *shard = FindMappedShard(channelId, shardStart);
+    if (shard == nullptr)
+      return false;
+    loaded = (time_t) shard->loaded;
+    return true;
+  }
+
+  void EpgStore::VisitShard(int channelId, time_t shardStart, time_t start, time_t end, const std::function<void(const epgEntry &)> &visit) const
+  {
+    // listings do not overlap, so ends are in order too and the first
+    // listing ending after start is found by binary search
+    std::map<int, std::map<time_t, shardListings>>::const_iterator it = m_channels.find(channelId);
+    if (it != m_channels.end())
+    {
+      std::map<time_t, shardListings>::const_iterator shard = it->second.find(shardStart);
+      if (shard != it->second.end())
+      {
+        const std::vector<epgEntry> &entries = shard->second.listings.Entries();
+        std::vector<epgEntry>::const_iterator first = std::upper_bound(entries.begin(), entries.end(), start, [](time_t t, const epgEntry &entry)
+        {
+          return t < entry.end;
+        });
+        for (std::vector<epgEntry>::const_iterator entry = first; entry != entries.end() && entry->start < end; ++entry)
+        {
+          visit(*entry);
+        }
+        return;
+      }
+    }
+
+    const cacheShard *shard = FindMappedShard(channelId, shardStart);
+    if (shard == nullptr)
+      return;
+    const cacheEvent *events = m_mappedEvents + shard->firstEvent;
+    const cacheEvent *eventsEnd = events + shard->eventCount;
+    const cacheEvent *first = std::upper_bound(events, eventsEnd, start, [](time_t t, const cacheEvent &event)
+    {
+      return t < event.end;
+    });
+    epgEntry entry;
+    for (const cacheEvent *event = first; event != eventsEnd && event->start < end; ++event)
+    {
+      ToEntry(*event, entry);
+      visit(entry);
+    }
+  }
+
+  void EpgStore::Put(int channelId, time_t shardStart, EpgListings &listings)
+  {
+    listings.Sort();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::map<time_t, shardListings> &shards = m_channels[channelId];
+    shardListings &shard = shards[shardStart];
+    shard.loaded = time(nullptr);
+    // frees the text of the listings replaced
+    shard.listings = std::move(listings);
+    listings = EpgListings();
+    shards.erase(shards.begin(), shards.lower_bound(OldestShard()));
+  }
+
+  bool EpgStore::Get(int channelId, time_t start, time_t end, const std::function<void(const epgEntry &)> &transfer, bool &current)
+  {
+    // copied out so transfer, which hands them to Kodi, runs without the lock
+    EpgListings listings;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (!HasChannel(channelId))
+        return false;
+      current = true;
+      time_t now = time(nullptr);
+      // shards back to start are kept from now on, else asking for them again
+      // would never be current
+      if (start > 0 && now - start > m_retain)
+        m_retain = now - start;
+      // the shard before start for a listing that started there
+      for (time_t shardStart = ShardStart(start) - EPG_SHARD_SECONDS; shardStart < end; shardStart += EPG_SHARD_SECONDS)
+      {
+        time_t loaded;
+        if (!ShardLoaded(channelId, shardStart, loaded))
+        {
+          if (shardStart + EPG_SHARD_SECONDS > start)
+            current = false;
+          continue;
+        }
+        if (shardStart + EPG_SHARD_SECONDS > start && now - loaded > MaxAge(shardStart))
+          current = false;
+        VisitShard(channelId, shardStart, start, end, [this, channelId, shardStart, &listings](const epgEntry &entry)
+        {
+          // a listing that started in an earlier shard comes with that shard
+          // once it is held
+          time_t loaded;
+          if (entry.start < shardStart && ShardLoaded(channelId, ShardStart(entry.start), loaded))
+            return;
+          listings.Add(entry);
+        });
+      }
+    }
+    for (const epgEntry &entry : listings.Entries())
+    {
+      transfer(entry);
+    }
+    return true;
+  }
+
+  bool EpgStore::NeedsFetch(int channelId, time_t shardStart)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    time_t loaded;
+    return !ShardLoaded(channelId, shardStart, loaded) || time(nullptr) - loaded > MaxAge(shardStart);
+  }
+
+  void EpgStore::SetChannels(const std::vector<int> &channelIds)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_channelIds = channelIds;
+  }
+
+  std::vector<int> EpgStore::GetChannels()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_channelIds.empty() || m_header == nullptr)
+      return m_channelIds;
+    // before the channel list was read, the channels of the cache file
+    std::vector<int> channelIds;
+    for (int i = 0; i < m_header->channelCount; i++)
+    {
+      channelIds.push_back(m_mappedChannels[i].channelId);
+    }
+    return channelIds;
+  }
+
+  void EpgStore::SetGuideLoaded(time_t start, time_t end)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_guideStart = start;
+    m_guideEnd = end;
+    m_guideLoaded = time(nullptr);
+  }
+
+  bool EpgStore::IsGuideLoaded(time_t start, time_t end)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_guideLoaded != 0 && start >= m_guideStart && end <= m_guideEnd && time(nullptr) - m_guideLoaded <= EPG_STORE_MAX_AGE;
+  }
+
+  void EpgStore::RequestRefresh(time_t start, time_t end, std::chrono::steady_clock::time_point loadStart)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_refresh)
+    {
+      m_refreshStart = std::min(m_refreshStart, start);
+      m_refreshEnd = std::max(m_refreshEnd, end);
+    }
+    else
+    {
+      m_refreshStart = start;
+      m_refreshEnd = end;
+    }
+    if (loadStart.time_since_epoch().count() != 0 && (m_refreshLoadStart.time_since_epoch().count() == 0 || loadStart < m_refreshLoadStart))
+      m_refreshLoadStart = loadStart;
+    m_refresh = true;
+  }
+
+  bool EpgStore::TakeRefresh(time_t &start, time_t &end, std::chrono::steady_clock::time_point &loadStart)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_refresh)
+      return false;
+    start = m_refreshStart;
+    end = m_refreshEnd;
+    loadStart = m_refreshLoadStart;
+    m_refreshLoadStart = std::chrono::steady_clock::time_point();
+    m_refresh = false;
+    return true;
+  }
+
+  void EpgStore::LogStats()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    int shardCount = 0;
+    int listingCount = 0;
+    size_t textBytes = 0;
+    size_t blocks = 0;
+    int interned = 0;
+    int internHits = 0;
+    for (const std::pair<const int, std::map<time_t, shardListings>> &channel : m_channels)
+    {
+      for (const std::pair<const time_t, shardListings> &shard : channel.second)
+      {
+        const EpgListings &listings = shard.second.listings;
+        shardCount++;
+        listingCount += (int) listings.Entries().size();
+        textBytes += listings.TextBytes();
+        blocks += listings.Blocks();
+        interned += listings.Interned();
+        internHits += listings.InternHits();
+      }
+    }
+    XBMC->Log(LOG_DEBUG, "%s:%d: %d channels, %d shards, %d listings in memory, %d KB of text in %d blocks, %d strings stored once for %d more uses", __FUNCTION__, __LINE__,
+      (int) m_channels.size(), shardCount, listingCount, (int) (textBytes / 1024), (int) blocks, interned, internHits);
+  }
+
+  void EpgStore::Clear()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_channels.clear();
+    m_guideLoaded = 0;
+  }
+}
@@ -0,0 +1,327 @@
+#pragma once
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <ctime>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <unordered_set>
+#include <stdint.h>
+
+namespace NextPVR
+{
+
+#define EPG_SHARD_SECONDS (6 * 3600) // listings are fetched and kept in blocks of this much time
+#define EPG_STORE_MAX_AGE 600 // sec before listings of the next day are fetched again
+#define EPG_STORE_FAR_MAX_AGE 3600 // sec before later listings are fetched again
+#define EPG_STORE_MIN_RETAIN (24 * 3600) // sec of past listings kept at least
+#define EPG_TEXT_BLOCK_SIZE 16384 // text of a shard's listings is kept in blocks this size
+
+  /**
+   * Guide listing as passed on to Kodi, the text is owned by the
+   * EpgListings or cache file it comes from
+   */
+  struct epgEntry
+  {
+    int id;
+    time_t start;
+    time_t end;
+    const char *title;
+    const char *subtitle;
+    const char *description;
+    const char *genre;
+    int year;
+    int genreType;
+    int genreSubtype;
+    int season;
+    int episode;
+  };
+
+  /**
+   * Listings of one channel and shard. Their text is copied into a few
+   * large blocks that are freed together when the listings are replaced.
+   * Titles, subtitles and genres repeat from day to day and are stored once.
+   */
+  class EpgListings
+  {
+    public:
+      EpgListings(void);
+
+      /**
+       * Adds a copy of entry and its text
+       */
+      void Add(const epgEntry &entry);
+      void Sort();
+      const std::vector<epgEntry> &Entries() const { return m_entries; }
+
+      size_t TextBytes() const { return m_textBytes; }
+      size_t Blocks() const { return m_blocks.size(); }
+      int Interned() const { return (int) m_interned.size(); }
+      int InternHits() const { return m_internHits; }
+
+    private:
+      struct textKey
+      {
+        const char *text;
+        size_t length;
+      };
+
+      struct textHash
+      {
+        size_t operator()(const textKey &key) const;
+      };
+
+      struct textEqual
+      {
+        bool operator()(const textKey &a, const textKey &b) const;
+      };
+
+      /**
+       * Copies text into the current block
+       */
+      const char *Store(const char *text, size_t length);
+
+      /**
+       * Stores text unless the same text is stored already
+       */
+      const char *Intern(const char *text);
+
+      std::vector<epgEntry> m_entries;
+      std::vector<std::unique_ptr<char[]>> m_blocks;
+      char *m_block;
+      size_t m_blockUsed;
+      size_t m_textBytes;
+      std::unordered_set<textKey, textHash, textEqual> m_interned;
+      int m_internHits;
+  };
+
+  /**
+   * Guide listings of all channels, split in shards of EPG_SHARD_SECONDS
+   * that are fetched and refreshed on their own. A listing belongs to the
+   * shard it starts in. The listings Kodi asks for one channel at a time
+   * come from one load of the whole guide.
+   *
+   * With a cache file the listings are saved as fixed size records and a
+   * string table, and read through a memory map, so a restart can answer
+   * from the last guide straight away.
+   */
+  class EpgStore
+  {
+    public:
+      EpgStore(void);
+      virtual ~EpgStore();
+
+      /**
+       * @return the start of the shard time falls in
+       */
+      static time_t ShardStart(time_t time) { return time - time % EPG_SHARD_SECONDS; }
+
+      /**
+       * @return seconds after which the shard starting at shardStart is
+       * fetched again
+       */
+      static int MaxAge(time_t shardStart);
+
+      /**
+       * Maps the cache file at path, saved listings are used until they
+       * are replaced
+       * @return false when there is no usable cache file
+       */
+      bool Open(const std::string &path);
+      void Close();
+
+      /**
+       * Writes all listings held to the cache file and maps it again, so
+       * they no longer take up memory
+       */
+      void Save();
+
+      /**
+       * Stores the listings of channelId fetched for the shard starting at
+       * shardStart, replacing those held
+       */
+      void Put(int channelId, time_t shardStart, EpgListings &listings);
+
+      /**
+       * Hands the listings of channelId overlapping start to end to
+       * transfer, their text is only valid during the call. Past listings
+       * are kept back to the earliest start asked for.
+       * @param current set when all shards of start to end are held and not too old
+       * @return false when nothing is held for channelId
+       */
+      bool Get(int channelId, time_t start, time_t end, const std::function<void(const epgEntry &)> &transfer, bool &current);
+
+      /**
+       * Hands the listings of each shard held to visit, their text is only
+       * valid during the call
+       */
+      void VisitShards(const std::function<void(int channelId, time_t shardStart, const std::vector<epgEntry> &entries)> &visit);
+
+      /**
+       * @return whether the shard of channelId starting at shardStart is
+       * missing or too old
+       */
+      bool NeedsFetch(int channelId, time_t shardStart);
+
+      /**
+       * Channels the whole guide is loaded for
+       */
+      void SetChannels(const std::vector<int> &channelIds);
+      std::vector<int> GetChannels();
+
+      /**
+       * Records a load of the whole guide for the window start to end
+       */
+      void SetGuideLoaded(time_t start, time_t end);
+
+      /**
+       * @return whether the whole guide was loaded for start to end recently
+       */
+      bool IsGuideLoaded(time_t start, time_t end);
+
+      /**
+       * Asks for a background refresh of the window start to end
+       * @param loadStart when the guide load this refresh completes began,
+       * if any, for timing it
+       */
+      void RequestRefresh(time_t start, time_t end, std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::time_point());
+
+      /**
+       * @return whether a refresh was asked for, its window and the start
+       * of the guide load it completes
+       */
+      bool TakeRefresh(time_t &start, time_t &end, std::chrono::steady_clock::time_point &loadStart);
+
+      /**
+       * Logs the listings held in memory and the size of their text
+       */
+      void LogStats();
+
+      void Clear();
+
+    private:
+      struct shardListings
+      {
+        time_t loaded;
+        EpgListings listings;
+      };
+
+      struct cacheHeader
+      {
+        int32_t magic;
+        int32_t version;
+        int32_t channelCount;
+        int32_t shardCount;
+        int32_t eventCount;
+        int32_t reserved;
+        int64_t stringBytes;
+      };
+
+      struct cacheChannel
+      {
+        int32_t channelId;
+        int32_t firstShard;
+        int32_t shardCount;
+        int32_t reserved;
+      };
+
+      struct cacheShard
+      {
+        int64_t start;
+        int64_t loaded;
+        int32_t firstEvent;
+        int32_t eventCount;
+      };
+
+      struct cacheEvent
+      {
+        int64_t start;
+        int64_t end;
+        int32_t id;
+        uint32_t title;
+        uint32_t subtitle;
+        uint32_t description;
+        uint32_t genre;
+        int32_t year;
+        int32_t genreType;
+        int32_t genreSubtype;
+        int32_t season;
+        int32_t episode;
+        int32_t reserved[2];
+      };
+
+      /**
+       * Hands the listings of a shard overlapping start to end, from memory
+       * or from the cache file, to visit
+       */
+      void VisitShard(int channelId, time_t shardStart, time_t start, time_t end, const std::function<void(const epgEntry &)> &visit) const;
+
+      /**
+       * Load time of a shard held in memory or in the cache file
+       */
+      bool ShardLoaded(int channelId, time_t shardStart, time_t &loaded) const;
+      bool HasChannel(int channelId) const;
+
+      /**
+       * Channels with listings in memory or in the cache file
+       */
+      std::vector<int> HeldChannels() const;
+      std::vector<time_t> Shards(int channelId) const;
+      const cacheChannel *FindMapped(int channelId) const;
+      const cacheShard *FindMappedShard(int channelId, time_t shardStart) const;
+      void ToEntry(const cacheEvent &event, epgEntry &entry) const;
+      const char *String(uint32_t offset) const;
+      bool Map();
+      void Unmap();
+
+      /**
+       * Start of the oldest shard kept, m_mutex held
+       */
+      time_t OldestShard() const { return ShardStart(time(nullptr) - m_retain); }
+
+      std::mutex m_mutex;
+      // by channel, then by shard start
+      std::map<int, std::map<time_t, shardListings>> m_channels;
+      std::vector<int> m_channelIds;
+      time_t m_guideStart;
+      time_t m_guideEnd;
+      time_t m_guideLoaded;
+      bool m_refresh;
+      time_t m_refreshStart;
+      time_t m_refreshEnd;
+      std::chrono::steady_clock::time_point m_refreshLoadStart;
+      time_t m_retain;
+
+      std::string m_path;
+      void *m_map;
+      size_t m_mapSize;
+      std::vector<char> m_mapCopy;
+      const cacheHeader *m_header;
+      const cacheChannel *m_mappedChannels;
+      const cacheShard *m_mappedShards;
+      const cacheEvent *m_mappedEvents;
+      const char *m_strings;
+  };
+}
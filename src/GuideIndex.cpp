@@ -0,0 +1,285 @@
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "GuideIndex.h"
+#include "client.h"
+#include <chrono>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <cstring>
+
+using namespace ADDON;
+
+namespace NextPVR
+{
+  GuideIndex::GuideIndex(void)
+  {
+    m_text.assign(1, '\0');
+    m_dead = 0;
+    m_indexUs = 0;
+    m_indexed = 0;
+  }
+
+  void GuideIndex::Tokenize(const char *text, std::vector<std::string> &words)
+  {
+    std::string word;
+    for (const char *c = text; ; c++)
+    {
+      unsigned char ch = (unsigned char) *c;
+      if ((ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') || ch >= 0x80)
+      {
+        word += (char) ch;
+        continue;
+      }
+      if (ch >= 'A' && ch <= 'Z')
+      {
+        word += (char) (ch - 'A' + 'a');
+        continue;
+      }
+      if (word.size() >= GUIDE_INDEX_MIN_WORD)
+        words.push_back(word);
+      word.clear();
+      if (ch == '\0')
+        break;
+    }
+  }
+
+  void GuideIndex::Put(int channelId, time_t shardStart, const std::vector<epgEntry> &entries)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Index(channelId, shardStart, entries);
+  }
+
+  void GuideIndex::Add(int channelId, time_t shardStart, const std::vector<epgEntry> &entries)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_shards.find(std::make_pair(channelId, shardStart)) == m_shards.end())
+      Index(channelId, shardStart, entries);
+  }
+
+  void GuideIndex::Index(int channelId, time_t shardStart, const std::vector<epgEntry> &entries)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // the documents replaced stay until the next compaction, unseen by searches
+    std::vector<std::pair<int, time_t>> dropped;
+    time_t oldest = EpgStore::ShardStart(time(nullptr) - 24 * 3600);
+    for (std::map<std::pair<int, time_t>, std::vector<uint32_t>>::iterator it = m_shards.lower_bound(std::make_pair(channelId, (time_t) 0));
+      it != m_shards.end() && it->first.first == channelId; ++it)
+    {
+      if (it->first.second == shardStart || it->first.second < oldest)
+        dropped.push_back(it->first);
+    }
+    for (const std::pair<int, time_t> &key : dropped)
+    {
+      for (uint32_t id : m_shards[key])
+      {
+        m_documents[id].live = false;
+      }
+      m_dead += m_shards[key].size();
+      m_shards.erase(key);
+    }
+
+    std::vector<uint32_t> &shard = m_shards[std::make_pair(channelId, shardStart)];
+    std::vector<std::string> words;
+    for (const epgEntry &entry : entries)
+    {
+      uint32_t id = (uint32_t) m_documents.size();
+      document doc;
+      doc.channelId = channelId;
+      doc.eventId = entry.id;
+      doc.start = entry.start;
+      doc.end = entry.end;
+      doc.title = (uint32_t) m_text.size();
+      doc.live = true;
+      m_text.append(entry.title, strlen(entry.title) + 1);
+      m_documents.push_back(doc);
+      shard.push_back(id);
+
+      words.clear();
+      Tokenize(entry.title, words);
+      Tokenize(entry.subtitle, words);
+      Tokenize(entry.description, words);
+      std::sort(words.begin(), words.end());
+      words.erase(std::unique(words.begin(), words.end()), words.end());
+      for (const std::string &word : words)
+      {
+        m_postings[word].push_back(id);
+      }
+    }
+    m_indexed += (int) entries.size();
+
+    if (m_dead > 4096 && m_dead > m_documents.size() / 2)
+      Compact();
+    m_indexUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  void GuideIndex::Compact()
+  {
+    const uint32_t removed = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> newIds(m_documents.size(), removed);
+    std::vector<document> documents;
+    documents.reserve(m_documents.size() - m_dead);
+    std::string text(1, '\0');
+    for (size_t i = 0; i < m_documents.size(); i++)
+    {
+      if (!m_documents[i].live)
+        continue;
+      newIds[i] = (uint32_t) documents.size();
+      document doc = m_documents[i];
+      const char *title = m_text.c_str() + doc.title;
+      doc.title = (uint32_t) text.size();
+      text.append(title, strlen(title) + 1);
+      documents.push_back(doc);
+    }
+    for (std::map<std::string, std::vector<uint32_t>>::iterator it = m_postings.begin(); it != m_postings.end(); )
+    {
+      std::vector<uint32_t> ids;
+      for (uint32_t id : it->second)
+      {
+        if (newIds[id] != removed)
+          ids.push_back(newIds[id]);
+      }
+      if (ids.empty())
+      {
+        it = m_postings.erase(it);
+        continue;
+      }
+      it->second.swap(ids);
+      ++it;
+    }
+    for (std::pair<const std::pair<int, time_t>, std::vector<uint32_t>> &shard : m_shards)
+    {
+      for (uint32_t &id : shard.second)
+      {
+        id = newIds[id];
+      }
+    }
+    m_documents.swap(documents);
+    m_text.swap(text);
+    m_dead = 0;
+  }
+
+  int GuideIndex::Search(const std::string &query, int channelId, time_t start, time_t end, bool fullText, const std::function<void(const guideMatch &)> &visit)
+  {
+    std::vector<std::string> words;
+    Tokenize(query.c_str(), words);
+    if (words.empty())
+      return 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::vector<uint32_t> found;
+    for (size_t i = 0; i < words.size(); i++)
+    {
+      // the documents of all indexed words starting with this one
+      std::vector<uint32_t> ids;
+      for (std::map<std::string, std::vector<uint32_t>>::const_iterator it = m_postings.lower_bound(words[i]);
+        it != m_postings.end() && it->first.compare(0, words[i].size(), words[i]) == 0; ++it)
+      {
+        ids.insert(ids.end(), it->second.begin(), it->second.end());
+      }
+      std::sort(ids.begin(), ids.end());
+      ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+      if (i == 0)
+      {
+        found.swap(ids);
+      }
+      else
+      {
+        std::vector<uint32_t> both;
+        std::set_intersection(found.begin(), found.end(), ids.begin(), ids.end(), std::back_inserter(both));
+        found.swap(both);
+      }
+      if (found.empty())
+        return 0;
+    }
+
+    std::vector<const document *> matches;
+    std::vector<std::string> titleWords;
+    for (uint32_t id : found)
+    {
+      const document &doc = m_documents[id];
+      if (!doc.live || (channelId >= 0 && doc.channelId != channelId) || doc.end <= start || doc.start >= end)
+        continue;
+      if (!fullText)
+      {
+        // the postings hold all words of a listing, so the title is checked here
+        titleWords.clear();
+        Tokenize(m_text.c_str() + doc.title, titleWords);
+        bool inTitle = true;
+        for (const std::string &word : words)
+        {
+          inTitle = inTitle && std::find_if(titleWords.begin(), titleWords.end(), [&word](const std::string &titleWord)
+          {
+            return titleWord.compare(0, word.size(), word) == 0;
+          }) != titleWords.end();
+        }
+        if (!inTitle)
+          continue;
+      }
+      matches.push_back(&doc);
+    }
+    std::sort(matches.begin(), matches.end(), [](const document *a, const document *b)
+    {
+      if (a->start != b->start)
+        return a->start < b->start;
+      return a->channelId < b->channelId;
+    });
+    int count = 0;
+    for (size_t i = 0; i < matches.size(); i++)
+    {
+      // a listing running into the next shard can come with both
+      if (i > 0 && matches[i]->start == matches[i - 1]->start && matches[i]->channelId == matches[i - 1]->channelId)
+        continue;
+      guideMatch match;
+      match.channelId = matches[i]->channelId;
+      match.eventId = matches[i]->eventId;
+      match.start = matches[i]->start;
+      match.end = matches[i]->end;
+      match.title = m_text.c_str() + matches[i]->title;
+      visit(match);
+      count++;
+    }
+    return count;
+  }
+
+  void GuideIndex::LogStats()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    size_t postings = 0;
+    size_t bytes = m_documents.capacity() * sizeof(document) + m_text.capacity();
+    for (const std::pair<const std::string, std::vector<uint32_t>> &word : m_postings)
+    {
+      postings += word.second.size();
+      // the map node and its key, roughly
+      bytes += word.second.capacity() * sizeof(uint32_t) + word.first.capacity() + 64;
+    }
+    for (const std::pair<const std::pair<int, time_t>, std::vector<uint32_t>> &shard : m_shards)
+    {
+      bytes += shard.second.capacity() * sizeof(uint32_t) + 64;
+    }
+    XBMC->Log(LOG_DEBUG, "%s:%d: %d listings, %d words, %d postings, %d KB, %d listings indexed in %d ms", __FUNCTION__, __LINE__,
+      (int) (m_documents.size() - m_dead), (int) m_postings.size(), (int) postings, (int) (bytes / 1024), m_indexed, (int) (m_indexUs / 1000));
+    m_indexUs = 0;
+    m_indexed = 0;
+  }
+}
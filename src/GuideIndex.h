@@ -0,0 +1,116 @@
+#pragma once
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <ctime>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <functional>
+#include <stdint.h>
+
+#include "EpgStore.h"
+
+namespace NextPVR
+{
+
+#define GUIDE_INDEX_MIN_WORD 2 // shorter words are not indexed
+
+  /**
+   * Guide listing found by GuideIndex::Search, the title is only valid
+   * during the visit
+   */
+  struct guideMatch
+  {
+    int channelId;
+    int eventId;
+    time_t start;
+    time_t end;
+    const char *title;
+  };
+
+  /**
+   * Inverted index over the words of the titles, subtitles and
+   * descriptions of the guide, kept per channel and shard so a refreshed
+   * shard only replaces its own listings. Words are lower case ASCII
+   * letters and digits, other UTF-8 characters are kept as they are.
+   */
+  class GuideIndex
+  {
+    public:
+      GuideIndex(void);
+      virtual ~GuideIndex() {};
+
+      /**
+       * Replaces the listings indexed for the shard of channelId starting
+       * at shardStart
+       */
+      void Put(int channelId, time_t shardStart, const std::vector<epgEntry> &entries);
+
+      /**
+       * Same as Put, unless the shard is indexed already
+       */
+      void Add(int channelId, time_t shardStart, const std::vector<epgEntry> &entries);
+
+      /**
+       * Hands the listings containing all words of query to visit, in
+       * order of start time. The words of query match the start of
+       * indexed words, so a word still being typed matches too.
+       * @param channelId only listings of this channel, any when negative
+       * @param fullText also match subtitles and descriptions, else titles only
+       * @return the number of listings found
+       */
+      int Search(const std::string &query, int channelId, time_t start, time_t end, bool fullText, const std::function<void(const guideMatch &)> &visit);
+
+      /**
+       * Logs the size of the index and the time spent indexing since the
+       * last call
+       */
+      void LogStats();
+
+    private:
+      struct document
+      {
+        int channelId;
+        int eventId;
+        time_t start;
+        time_t end;
+        uint32_t title;
+        bool live;
+      };
+
+      static void Tokenize(const char *text, std::vector<std::string> &words);
+      void Index(int channelId, time_t shardStart, const std::vector<epgEntry> &entries);
+      void Compact();
+
+      std::mutex m_mutex;
+      std::vector<document> m_documents;
+      // documents of each channel and shard
+      std::map<std::pair<int, time_t>, std::vector<uint32_t>> m_shards;
+      // documents containing each word, in increasing order
+      std::map<std::string, std::vector<uint32_t>> m_postings;
+      std::string m_text;
+      size_t m_dead;
+      int64_t m_indexUs;
+      int m_indexed;
+  };
+}
@@ -0,0 +1,374 @@
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <stdlib.h>
+
+#include "client.h"
+#include "HttpClient.h"
+#include "p8-platform/util/timeutils.h"
+
+using namespace ADDON;
+
+#define HTTP_POOL_SIZE 4          // idle connections kept open
+#define HTTP_IDLE_TIMEOUT 30      // sec, idle connections older than this are not reused
+#define HTTP_RECEIVE_TIMEOUT 30   // sec
+#define HTTP_MAX_HEADER 65536
+#define HTTP_STATS_INTERVAL 100   // requests between stats in the log
+
+namespace NextPVR
+{
+  HttpClient::HttpClient(void)
+  {
+    m_connects = 0;
+    m_reuses = 0;
+    m_requests = 0;
+    m_pipelined = 0;
+    m_failures = 0;
+    m_totalMs = 0;
+    m_maxMs = 0;
+  }
+
+  HttpClient::~HttpClient()
+  {
+    if (m_requests > 0)
+      LogStats();
+    Close();
+  }
+
+  bool HttpClient::Get(const std::string &resource, int &status, std::string &body, int connectTimeout, bool retry)
+  {
+    validator cacheValidator;
+    return Get(resource, status, body, connectTimeout, cacheValidator, retry);
+  }
+
+  bool HttpClient::Get(const std::string &resource, int &status, std::string &body, int connectTimeout, validator &cacheValidator, bool retry)
+  {
+    std::string headers;
+    if (!cacheValidator.etag.empty())
+      headers += "If-None-Match: " + cacheValidator.etag + "\r\n";
+    if (!cacheValidator.lastModified.empty())
+      headers += "If-Modified-Since: " + cacheValidator.lastModified + "\r\n";
+
+    int64_t start = P8PLATFORM::GetTimeMs();
+    std::vector<std::string> resources(1, resource);
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+      connection conn;
+      if (!Acquire(conn, connectTimeout))
+        break;
+
+      std::string buffer;
+      bool keepAlive = false;
+      status = 0;
+      if (Send(conn, resources, headers) && ReadResponse(conn, buffer, status, body, keepAlive, &cacheValidator))
+      {
+        Release(conn, keepAlive && buffer.empty());
+        AddLatency(start, 1);
+        return true;
+      }
+      Release(conn, false);
+
+      // the backend may have dropped an idle connection just as it was reused,
+      // try once more on a new one if nothing came back
+      if (!retry || !conn.reused || status != 0)
+        break;
+      XBMC->Log(LOG_DEBUG, "%s:%d: stale connection for %s", __FUNCTION__, __LINE__, resource.c_str());
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_failures++;
+    return false;
+  }
+
+  bool HttpClient::GetPipelined(const std::vector<std::string> &resources, std::vector<int> &status, std::vector<std::string> &bodies)
+  {
+    int64_t start = P8PLATFORM::GetTimeMs();
+    status.assign(resources.size(), 0);
+    bodies.assign(resources.size(), std::string());
+
+    connection conn;
+    if (!Acquire(conn, HTTP_CONNECT_TIMEOUT))
+      return false;
+
+    std::string buffer;
+    bool keepAlive = true;
+    bool ok = Send(conn, resources, "");
+    for (size_t i = 0; ok && i < resources.size(); i++)
+    {
+      ok = ReadResponse(conn, buffer, status[i], bodies[i], keepAlive, nullptr);
+      // the backend may close after any response, the requests after it are lost
+      if (ok && !keepAlive && i + 1 < resources.size())
+        ok = false;
+    }
+    Release(conn, ok && keepAlive && buffer.empty());
+
+    if (!ok)
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_failures++;
+      return false;
+    }
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_pipelined += resources.size();
+    }
+    AddLatency(start, resources.size());
+    return true;
+  }
+
+  void HttpClient::Close()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (connection &conn : m_idle)
+    {
+      delete conn.socket;
+    }
+    m_idle.clear();
+  }
+
+  void HttpClient::LogStats()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    XBMC->Log(LOG_DEBUG, "%s:%d: %d requests (%d pipelined), %d connections opened, %d reused, %d failed, latency avg %d max %d ms", __FUNCTION__, __LINE__,
+      m_requests, m_pipelined, m_connects, m_reuses, m_failures,
+      m_requests > 0 ? (int) (m_totalMs / m_requests) : 0, (int) m_maxMs);
+  }
+
+  bool HttpClient::Acquire(connection &conn, int connectTimeout)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      int64_t now = P8PLATFORM::GetTimeMs();
+      while (!m_idle.empty())
+      {
+        conn = m_idle.back();
+        m_idle.pop_back();
+        // an idle connection with data waiting is normally the backend closing it
+        if (now - conn.idleSince < HTTP_IDLE_TIMEOUT * 1000 && !conn.socket->read_ready(0))
+        {
+          conn.reused = true;
+          m_reuses++;
+          return true;
+        }
+        delete conn.socket;
+      }
+    }
+
+    conn.socket = new Socket(af_inet, pf_inet, sock_stream, tcp);
+    conn.reused = false;
+    conn.idleSince = 0;
+    if (!conn.socket->create() || !conn.socket->connect(g_szHostname, g_iPort, connectTimeout))
+    {
+      delete conn.socket;
+      conn.socket = nullptr;
+      return false;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_connects++;
+    return true;
+  }
+
+  void HttpClient::Release(connection &conn, bool keepAlive)
+  {
+    if (keepAlive && conn.socket->is_valid())
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (m_idle.size() < HTTP_POOL_SIZE)
+      {
+        conn.idleSince = P8PLATFORM::GetTimeMs();
+        m_idle.push_back(conn);
+        return;
+      }
+    }
+    delete conn.socket;
+    conn.socket = nullptr;
+  }
+
+  bool HttpClient::Send(connection &conn, const std::vector<std::string> &resources, const std::string &headers)
+  {
+    char host[256];
+    snprintf(host, sizeof(host), "%s:%d", g_szHostname.c_str(), g_iPort);
+    std::string request;
+    for (const std::string &resource : resources)
+    {
+      request += "GET " + resource + " HTTP/1.1\r\n";
+      request += "Host: " + std::string(host) + "\r\n";
+      request += "Connection: keep-alive\r\n";
+      request += headers + "\r\n";
+    }
+    return conn.socket->send(request) == (int) request.size();
+  }
+
+  bool HttpClient::ReadResponse(connection &conn, std::string &buffer, int &status, std::string &body, bool &keepAlive, validator *cacheValidator)
+  {
+    status = 0;
+    keepAlive = false;
+    body.clear();
+
+    size_t headerEnd;
+    while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos)
+    {
+      if (buffer.size() > HTTP_MAX_HEADER || !Fill(conn, buffer))
+        return false;
+    }
+    std::string headers = buffer.substr(0, headerEnd);
+    buffer.erase(0, headerEnd + 4);
+
+    size_t space = headers.find(' ');
+    if (headers.compare(0, 5, "HTTP/") != 0 || space == std::string::npos)
+    {
+      XBMC->Log(LOG_ERROR, "%s:%d: bad status line", __FUNCTION__, __LINE__);
+      return false;
+    }
+    status = atoi(headers.c_str() + space + 1);
+    keepAlive = headers.compare(0, 8, "HTTP/1.0") != 0;
+    // a 304 may leave out the validators it confirms
+    if (cacheValidator != nullptr && status != 304)
+      *cacheValidator = validator();
+
+    int64_t contentLength = -1;
+    bool chunked = false;
+    size_t lineStart = headers.find("\r\n");
+    while (lineStart != std::string::npos)
+    {
+      lineStart += 2;
+      size_t lineEnd = headers.find("\r\n", lineStart);
+      std::string line = headers.substr(lineStart, lineEnd == std::string::npos ? std::string::npos : lineEnd - lineStart);
+      size_t colon = line.find(':');
+      if (colon != std::string::npos)
+      {
+        std::string name = line.substr(0, colon);
+        size_t valueStart = line.find_first_not_of(' ', colon + 1);
+        std::string value = valueStart == std::string::npos ? "" : line.substr(valueStart);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        // validators are compared byte for byte, keep them as sent
+        if (cacheValidator != nullptr && name == "etag")
+          cacheValidator->etag = value;
+        else if (cacheValidator != nullptr && name == "last-modified")
+          cacheValidator->lastModified = value;
+        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+        if (name == "content-length")
+          contentLength = strtoll(value.c_str(), nullptr, 10);
+        else if (name == "transfer-encoding" && value.find("chunked") != std::string::npos)
+          chunked = true;
+        else if (name == "connection" && value.find("close") != std::string::npos)
+          keepAlive = false;
+        else if (name == "connection" && value.find("keep-alive") != std::string::npos)
+          keepAlive = true;
+      }
+      lineStart = lineEnd;
+    }
+
+    if (chunked)
+    {
+      while (true)
+      {
+        size_t lineEnd;
+        while ((lineEnd = buffer.find("\r\n")) == std::string::npos)
+        {
+          if (!Fill(conn, buffer))
+            return false;
+        }
+        size_t chunkSize = strtoul(buffer.c_str(), nullptr, 16);
+        buffer.erase(0, lineEnd + 2);
+        if (chunkSize == 0)
+          break;
+        while (buffer.size() < chunkSize + 2)
+        {
+          if (!Fill(conn, buffer))
+            return false;
+        }
+        body.append(buffer, 0, chunkSize);
+        buffer.erase(0, chunkSize + 2);
+      }
+      // skip any trailers up to the empty line
+      while (true)
+      {
+        size_t lineEnd;
+        while ((lineEnd = buffer.find("\r\n")) == std::string::npos)
+        {
+          if (!Fill(conn, buffer))
+            return false;
+        }
+        buffer.erase(0, lineEnd + 2);
+        if (lineEnd == 0)
+          break;
+      }
+    }
+    else if (contentLength >= 0)
+    {
+      // the body is received straight into its final size, whatever came
+      // with the headers is moved over first
+      body.reserve(contentLength);
+      size_t headed = std::min((size_t) contentLength, buffer.size());
+      body.assign(buffer, 0, headed);
+      buffer.erase(0, headed);
+      while ((int64_t) body.size() < contentLength)
+      {
+        if (!Fill(conn, body, std::min((int64_t) HTTP_BLOCK_SIZE, contentLength - (int64_t) body.size())))
+          return false;
+      }
+    }
+    else if (status != 204 && status != 304 && status >= 200)
+    {
+      // no length given, the body runs until the backend closes the connection
+      while (Fill(conn, buffer))
+      {
+      }
+      body.swap(buffer);
+      buffer.clear();
+      keepAlive = false;
+    }
+    return true;
+  }
+
+  bool HttpClient::Fill(connection &conn, std::string &buffer, size_t maxBytes)
+  {
+    int64_t start = P8PLATFORM::GetTimeMs();
+    while (!conn.socket->read_ready())
+    {
+      if (!conn.socket->is_valid() || P8PLATFORM::GetTimeMs() - start > HTTP_RECEIVE_TIMEOUT * 1000)
+      {
+        XBMC->Log(LOG_ERROR, "%s:%d: timeout waiting for response", __FUNCTION__, __LINE__);
+        return false;
+      }
+    }
+    size_t used = buffer.size();
+    buffer.resize(used + maxBytes);
+    int count = conn.socket->receive(&buffer[used], maxBytes, 0);
+    buffer.resize(count > 0 ? used + count : used);
+    return count > 0;
+  }
+
+  void HttpClient::AddLatency(int64_t start, int requests)
+  {
+    int64_t elapsed = P8PLATFORM::GetTimeMs() - start;
+    bool logStats;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_requests += requests;
+      m_totalMs += elapsed;
+      m_maxMs = std::max(m_maxMs, elapsed);
+      logStats = m_requests % HTTP_STATS_INTERVAL < requests;
+    }
+    if (logStats)
+      LogStats();
+  }
+}
@@ -0,0 +1,118 @@
+#pragma once
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdint.h>
+
+#include "Socket.h"
+
+namespace NextPVR
+{
+
+#define HTTP_CONNECT_TIMEOUT 10 //sec
+#define HTTP_BLOCK_SIZE 65536 // most bytes received at once
+
+  /**
+   * HTTP/1.1 client for the backend service calls. Connections are kept
+   * alive and returned to a small pool, so consecutive calls do not pay
+   * for a new connection each time.
+   */
+  class HttpClient
+  {
+    public:
+      /**
+       * Cache validators of a response. Set on a request they are sent as
+       * If-None-Match and If-Modified-Since, and a 304 status then means
+       * the cached body is still current.
+       */
+      struct validator
+      {
+        std::string etag;
+        std::string lastModified;
+      };
+
+      HttpClient(void);
+      virtual ~HttpClient();
+
+      /**
+       * Sends a GET for resource and reads the whole response
+       * @param connectTimeout seconds allowed to open a new connection
+       * @param retry whether the request is safe to send again on a new
+       * connection when a reused one turns out to be dropped, the backend
+       * may have run it already
+       * @return false when no complete response was received
+       */
+      bool Get(const std::string &resource, int &status, std::string &body, int connectTimeout, bool retry);
+
+      /**
+       * Sends a conditional GET, cacheValidator is replaced by the one of
+       * the response
+       */
+      bool Get(const std::string &resource, int &status, std::string &body, int connectTimeout, validator &cacheValidator, bool retry);
+
+      /**
+       * Sends the GETs for all resources on one connection before reading
+       * their responses in order. Only use it for calls that are safe to
+       * repeat, a broken connection leaves no way to tell which ran.
+       * @return false when not all responses were received
+       */
+      bool GetPipelined(const std::vector<std::string> &resources, std::vector<int> &status, std::vector<std::string> &bodies);
+
+      /**
+       * Closes all idle connections
+       */
+      void Close();
+
+      void LogStats();
+
+    private:
+      struct connection
+      {
+        Socket *socket;
+        int64_t idleSince;
+        bool reused;
+      };
+
+      bool Acquire(connection &conn, int connectTimeout);
+      void Release(connection &conn, bool keepAlive);
+      bool Send(connection &conn, const std::vector<std::string> &resources, const std::string &headers);
+      bool ReadResponse(connection &conn, std::string &buffer, int &status, std::string &body, bool &keepAlive, validator *cacheValidator);
+
+      /**
+       * Receives up to maxBytes at the end of buffer
+       * @return false on timeout or when the connection was closed
+       */
+      bool Fill(connection &conn, std::string &buffer, size_t maxBytes = HTTP_BLOCK_SIZE);
+      void AddLatency(int64_t start, int requests);
+
+      std::mutex m_mutex;
+      std::vector<connection> m_idle;
+      int m_connects;
+      int m_reuses;
+      int m_requests;
+      int m_pipelined;
+      int m_failures;
+      int64_t m_totalMs;
+      int64_t m_maxMs;
+  };
+}
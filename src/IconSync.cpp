@@ -0,0 +1,244 @@
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "IconSync.h"
+#include "BackendRequest.h"
+#include "client.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <stdio.h>
+
+using namespace ADDON;
+
+#define HTTP_OK 200
+#define HTTP_NOT_MODIFIED 304
+
+#define ICON_MANIFEST_HEADER "nextpvr icons 1"
+
+namespace NextPVR
+{
+  IconSync::IconSync(void)
+  {
+    m_loaded = false;
+  }
+
+  void IconSync::Open(const std::string &path)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_path = path;
+    m_icons.clear();
+    m_queue.clear();
+    m_queuedIds.clear();
+    m_loaded = Load();
+  }
+
+  bool IconSync::Load()
+  {
+    char *path = XBMC->TranslateSpecialProtocol(m_path.c_str());
+    FILE *file = fopen(path, "r");
+    XBMC->FreeString(path);
+    if (file == nullptr)
+      return false;
+
+    // a line per channel: id, size, time checked, ETag and Last-Modified, tab separated
+    char line[1024];
+    bool ok = fgets(line, sizeof(line), file) != nullptr && strncmp(line, ICON_MANIFEST_HEADER "\n", sizeof(line)) == 0;
+    while (ok && fgets(line, sizeof(line), file) != nullptr)
+    {
+      std::vector<std::string> fields;
+      char *field = line;
+      for (char *c = line; ; c++)
+      {
+        if (*c == '\t' || *c == '\n' || *c == '\0')
+        {
+          fields.push_back(std::string(field, c - field));
+          if (*c != '\t')
+            break;
+          field = c + 1;
+        }
+      }
+      if (fields.size() != 5)
+        continue;
+      icon entry;
+      entry.size = atoll(fields[1].c_str());
+      entry.checked = (time_t) atoll(fields[2].c_str());
+      entry.cacheValidator.etag = fields[3];
+      entry.cacheValidator.lastModified = fields[4];
+      m_icons[atoi(fields[0].c_str())] = entry;
+    }
+    fclose(file);
+    if (!ok)
+    {
+      XBMC->Log(LOG_NOTICE, "%s:%d: ignoring %s", __FUNCTION__, __LINE__, m_path.c_str());
+      m_icons.clear();
+    }
+    return ok;
+  }
+
+  void IconSync::Save()
+  {
+    char *path = XBMC->TranslateSpecialProtocol(m_path.c_str());
+    std::string filePath = path;
+    XBMC->FreeString(path);
+
+    std::string tempPath = filePath + ".tmp";
+    FILE *file = fopen(tempPath.c_str(), "w");
+    if (file == nullptr)
+    {
+      XBMC->Log(LOG_ERROR, "%s:%d: cannot write %s", __FUNCTION__, __LINE__, tempPath.c_str());
+      return;
+    }
+    bool ok = fputs(ICON_MANIFEST_HEADER "\n", file) >= 0;
+    for (const std::pair<const int, icon> &entry : m_icons)
+    {
+      ok = ok && fprintf(file, "%d\t%lld\t%lld\t%s\t%s\n", entry.first, (long long) entry.second.size, (long long) entry.second.checked,
+        entry.second.cacheValidator.etag.c_str(), entry.second.cacheValidator.lastModified.c_str()) > 0;
+    }
+    ok = fclose(file) == 0 && ok;
+#if defined(TARGET_WINDOWS)
+    remove(filePath.c_str());
+#endif
+    if (!ok || rename(tempPath.c_str(), filePath.c_str()) != 0)
+    {
+      XBMC->Log(LOG_ERROR, "%s:%d: cannot save %s", __FUNCTION__, __LINE__, m_path.c_str());
+      remove(tempPath.c_str());
+    }
+  }
+
+  std::string IconSync::GetIcon(int channelId, const std::string &fileName)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::map<int, icon>::iterator it = m_icons.find(channelId);
+    if (it == m_icons.end() && !m_loaded && XBMC->FileExists(fileName.c_str(), false))
+    {
+      // icons fetched before there was a manifest are taken as they are
+      icon entry;
+      entry.size = 0;
+      entry.checked = time(nullptr);
+      it = m_icons.insert(std::make_pair(channelId, entry)).first;
+    }
+    if ((it == m_icons.end() || time(nullptr) - it->second.checked > ICON_RECHECK_SECONDS) && m_queuedIds.insert(channelId).second)
+    {
+      queued request;
+      request.channelId = channelId;
+      request.fileName = fileName;
+      m_queue.push_back(request);
+    }
+    if (it == m_icons.end())
+      return "";
+    return fileName;
+  }
+
+  bool IconSync::Sync(const std::function<bool()> &stopping)
+  {
+    std::vector<queued> requests;
+    std::map<int, icon> held;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (m_queue.empty())
+        return false;
+      requests.swap(m_queue);
+      for (const queued &request : requests)
+      {
+        std::map<int, icon>::const_iterator it = m_icons.find(request.channelId);
+        if (it != m_icons.end())
+          held[request.channelId] = it->second;
+      }
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::mutex mutex;
+    std::condition_variable finished;
+    int pending = 0;
+    int changed = 0;
+    int unchanged = 0;
+    int failed = 0;
+    int64_t bytes = 0;
+    std::map<int, icon> results;
+    for (const queued &request : requests)
+    {
+      if (stopping())
+        break;
+      // a validator is only worth sending while the file is still there
+      HttpClient::validator cacheValidator;
+      std::map<int, icon>::const_iterator it = held.find(request.channelId);
+      if (it != held.end() && XBMC->FileExists(request.fileName.c_str(), false))
+        cacheValidator = it->second.cacheValidator;
+      {
+        // a few copies queued at a time, so that unloading is not held up
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&pending]() { return pending < ICON_MAX_PENDING; });
+        pending++;
+      }
+      char strURL[256];
+      sprintf(strURL, "/service?method=channel.icon&channel_id=%d", request.channelId);
+      int channelId = request.channelId;
+      int64_t size = it != held.end() ? it->second.size : 0;
+      m_backEnd->FileCopyAsync(strURL, request.fileName, cacheValidator, [&, channelId, size](int resultCode, int64_t written, const HttpClient::validator &responseValidator)
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (resultCode == HTTP_OK || resultCode == HTTP_NOT_MODIFIED)
+        {
+          icon &entry = results[channelId];
+          entry.size = resultCode == HTTP_OK ? written : size;
+          entry.checked = time(nullptr);
+          entry.cacheValidator = responseValidator;
+        }
+        if (resultCode == HTTP_OK)
+        {
+          bytes += written;
+          changed++;
+        }
+        else if (resultCode == HTTP_NOT_MODIFIED)
+        {
+          unchanged++;
+        }
+        else
+        {
+          // asked for again the next time the channels are listed
+          failed++;
+        }
+        pending--;
+        finished.notify_one();
+      });
+    }
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      finished.wait(lock, [&pending]() { return pending == 0; });
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (const std::pair<const int, icon> &result : results)
+    {
+      m_icons[result.first] = result.second;
+    }
+    for (const queued &request : requests)
+    {
+      m_queuedIds.erase(request.channelId);
+    }
+    m_loaded = true;
+    Save();
+    XBMC->Log(LOG_DEBUG, "%s:%d: %d icons, %d fetched, %d current, %d failed, %lld bytes in %d ms", __FUNCTION__, __LINE__, (int) requests.size(), changed, unchanged, failed, (long long) bytes,
+      (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+    return changed != 0;
+  }
+}
@@ -0,0 +1,95 @@
+#pragma once
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <functional>
+#include <ctime>
+#include <stdint.h>
+
+#include "HttpClient.h"
+
+namespace NextPVR
+{
+
+#define ICON_RECHECK_SECONDS (7 * 24 * 3600) // icons held are asked for again after a week
+#define ICON_MAX_PENDING 16 // icon copies waiting on the backend's workers at a time
+
+  /**
+   * Keeps the channel icons in the add-on's data folder along with a
+   * manifest of them, so the channel list gets their paths without a look
+   * at the disk. Missing and old icons are fetched in the background.
+   */
+  class IconSync
+  {
+    public:
+      IconSync(void);
+      virtual ~IconSync() {};
+
+      /**
+       * Reads the manifest at path
+       */
+      void Open(const std::string &path);
+
+      /**
+       * @return fileName when the icon of channelId is held, empty
+       * otherwise. Missing and old icons are queued for Sync.
+       */
+      std::string GetIcon(int channelId, const std::string &fileName);
+
+      /**
+       * Fetches the queued icons in parallel on the backend's workers and
+       * saves the manifest
+       * @param stopping tells to leave the icons not asked for yet, for unloading
+       * @return whether any icon was added or replaced
+       */
+      bool Sync(const std::function<bool()> &stopping);
+
+    private:
+      struct icon
+      {
+        int64_t size;  // 0 when not known
+        time_t checked;
+        HttpClient::validator cacheValidator;
+      };
+
+      struct queued
+      {
+        int channelId;
+        std::string fileName;
+      };
+
+      bool Load();
+      void Save();
+
+      std::mutex m_mutex;
+      std::string m_path;
+      bool m_loaded;
+      std::map<int, icon> m_icons;
+      std::vector<queued> m_queue;
+      // queued or being fetched, each channel is fetched once at a time
+      std::set<int> m_queuedIds;
+  };
+}
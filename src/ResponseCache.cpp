@@ -0,0 +1,124 @@
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "client.h"
+#include "ResponseCache.h"
+
+using namespace ADDON;
+
+namespace NextPVR
+{
+  struct methodTimeToLive
+  {
+    const char *method;
+    int seconds;
+  };
+
+  // the channel catalog keeps channel.list and channel.groups itself
+  static const methodTimeToLive cachedMethods[] =
+  {
+    { "method=setting.list", 600 }
+  };
+
+  ResponseCache::ResponseCache(void)
+  {
+    m_hits = 0;
+    m_misses = 0;
+    m_revalidated = 0;
+    m_invalidated = 0;
+  }
+
+  int ResponseCache::TimeToLive(const std::string &resource)
+  {
+    for (const methodTimeToLive &cached : cachedMethods)
+    {
+      if (resource.find(cached.method) != std::string::npos)
+        return cached.seconds;
+    }
+    return 0;
+  }
+
+  bool ResponseCache::Get(const std::string &resource, std::string &response, HttpClient::validator &cacheValidator, bool &fresh)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::map<std::string, entry>::const_iterator it = m_entries.find(resource);
+    if (it == m_entries.end())
+    {
+      m_misses++;
+      return false;
+    }
+    fresh = time(nullptr) < it->second.expires;
+    if (fresh)
+      m_hits++;
+    else
+      m_misses++;
+    response = it->second.response;
+    cacheValidator = it->second.cacheValidator;
+    return true;
+  }
+
+  void ResponseCache::Put(const std::string &resource, const std::string &response, const HttpClient::validator &cacheValidator)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    entry &cached = m_entries[resource];
+    cached.response = response;
+    cached.cacheValidator = cacheValidator;
+    cached.expires = time(nullptr) + TimeToLive(resource);
+  }
+
+  void ResponseCache::Refresh(const std::string &resource, const HttpClient::validator &cacheValidator)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::map<std::string, entry>::iterator it = m_entries.find(resource);
+    if (it != m_entries.end())
+    {
+      it->second.cacheValidator = cacheValidator;
+      it->second.expires = time(nullptr) + TimeToLive(resource);
+      m_revalidated++;
+    }
+  }
+
+  void ResponseCache::Invalidate(const std::string &method)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::string prefix = "method=" + method;
+    std::map<std::string, entry>::iterator it = m_entries.begin();
+    while (it != m_entries.end())
+    {
+      if (it->first.find(prefix) != std::string::npos)
+      {
+        it = m_entries.erase(it);
+        m_invalidated++;
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+
+  void ResponseCache::LogStats()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    XBMC->Log(LOG_DEBUG, "%s:%d: %d entries, %d hits, %d misses, %d revalidated, %d invalidated", __FUNCTION__, __LINE__,
+      (int) m_entries.size(), m_hits, m_misses, m_revalidated, m_invalidated);
+  }
+}
@@ -0,0 +1,85 @@
+#pragma once
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <ctime>
+
+#include "HttpClient.h"
+
+namespace NextPVR
+{
+  /**
+   * Keeps the responses of backend calls that change rarely, keyed by the
+   * resource without the session id. Entries expire after a time set per
+   * method; an expired entry with validators is revalidated rather than
+   * fetched again.
+   */
+  class ResponseCache
+  {
+    public:
+      ResponseCache(void);
+      virtual ~ResponseCache() {};
+
+      /**
+       * @return how long in seconds responses of resource are kept, 0 when they are not cached
+       */
+      static int TimeToLive(const std::string &resource);
+
+      /**
+       * Looks up resource
+       * @param fresh set when the entry has not expired yet
+       * @return whether there was an entry, fresh or not
+       */
+      bool Get(const std::string &resource, std::string &response, HttpClient::validator &cacheValidator, bool &fresh);
+
+      void Put(const std::string &resource, const std::string &response, const HttpClient::validator &cacheValidator);
+
+      /**
+       * Restarts the lifetime of an entry the backend confirmed as current
+       */
+      void Refresh(const std::string &resource, const HttpClient::validator &cacheValidator);
+
+      /**
+       * Drops the entries of all methods starting with method, an empty
+       * method drops everything
+       */
+      void Invalidate(const std::string &method);
+
+      void LogStats();
+
+    private:
+      struct entry
+      {
+        std::string response;
+        HttpClient::validator cacheValidator;
+        time_t expires;
+      };
+
+      std::mutex m_mutex;
+      std::map<std::string, entry> m_entries;
+      int m_hits;
+      int m_misses;
+      int m_revalidated;
+      int m_invalidated;
+  };
+}
@@ -82,15 +82,14 @@ bool Socket::setHostname ( const std::string& host )
   return true;
 }
 
-bool Socket::read_ready()
+bool Socket::read_ready(const int timeoutMs)
 {
   fd_set fdset;
 
   FD_ZERO(&fdset);
   FD_SET(_sd, &fdset);
 
-  struct timeval tv = { 1, 0 };
-  //  tv.tv_sec = 1;
+  struct timeval tv = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
 
   int retVal = select(_sd+1, &fdset, NULL, NULL, &tv);
   if (retVal > 0)
@@ -510,6 +509,66 @@ bool Socket::connect ( const std::string& host, const unsigned short port )
   return true;
 }
 
+bool Socket::connect ( const std::string& host, const unsigned short port, const int timeout )
+{
+  if ( !is_valid() )
+  {
+    return false;
+  }
+
+  _sockaddr.sin_family = _family;
+  _sockaddr.sin_port = htons ( port );
+
+  if ( !setHostname( host ) )
+  {
+    XBMC->Log(LOG_ERROR, "Socket::setHostname(%s) failed.\n", host.c_str());
+    return false;
+  }
+
+  if ( !set_non_blocking( true ) )
+  {
+    return false;
+  }
+
+  int status = ::connect ( _sd, reinterpret_cast<sockaddr*>(&_sockaddr), sizeof ( _sockaddr ) );
+
+  if ( status == SOCKET_ERROR )
+  {
+    int lasterror = getLastError();
+#if defined(TARGET_WINDOWS)
+    if ( lasterror != WSAEWOULDBLOCK )
+#else
+    if ( lasterror != EINPROGRESS )
+#endif
+    {
+      XBMC->Log(LOG_ERROR, "Socket::connect %s:%u\n", host.c_str(), port);
+      errormessage( lasterror, "Socket::connect" );
+      return false;
+    }
+
+    fd_set set_w;
+    FD_ZERO(&set_w);
+    FD_SET(_sd, &set_w);
+    struct timeval tv = { timeout, 0 };
+    if ( select(_sd+1, NULL, &set_w, NULL, &tv) <= 0 )
+    {
+      XBMC->Log(LOG_ERROR, "Socket::connect %s:%u timed out\n", host.c_str(), port);
+      return false;
+    }
+
+    int error = 0;
+    socklen_t length = sizeof( error );
+    if ( getsockopt(_sd, SOL_SOCKET, SO_ERROR, (char*) &error, &length) == SOCKET_ERROR || error != 0 )
+    {
+      XBMC->Log(LOG_ERROR, "Socket::connect %s:%u\n", host.c_str(), port);
+      errormessage( error, "Socket::connect" );
+      return false;
+    }
+  }
+
+  return set_non_blocking( false );
+}
+
 bool Socket::reconnect()
 {
   if ( _sd != INVALID_SOCKET )
@@ -205,6 +205,12 @@ class Socket
     // Client initialization
     bool connect ( const std::string& host, const unsigned short port );
 
+    /*!
+     * Socket connect with a limit on how long the connection may take
+     * \param timeout    Seconds to wait for the connection to be established
+     */
+    bool connect ( const std::string& host, const unsigned short port, const int timeout );
+
     bool reconnect();
 
     // Data Transmission
@@ -281,7 +287,7 @@ class Socket
 
     bool is_valid() const;
 
-	bool read_ready();
+	bool read_ready(const int timeoutMs = 1000);
 
   private:
 
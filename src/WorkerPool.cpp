@@ -0,0 +1,88 @@
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "WorkerPool.h"
+
+namespace NextPVR
+{
+  void WorkerPool::Start(int workers)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stop = false;
+    for (int i = 0; i < workers; i++)
+    {
+      m_threads.push_back(std::thread([this]()
+      {
+        WorkerProc();
+      }));
+    }
+  }
+
+  void WorkerPool::Stop()
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_stop = true;
+      m_queued.notify_all();
+    }
+    for (std::thread &thread : m_threads)
+    {
+      if (thread.joinable())
+        thread.join();
+    }
+    m_threads.clear();
+  }
+
+  void WorkerPool::Submit(const std::function<void()> &task)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (!m_threads.empty() && !m_stop)
+      {
+        m_tasks.push_back(task);
+        m_queued.notify_one();
+        return;
+      }
+    }
+    task();
+  }
+
+  void WorkerPool::WorkerProc()
+  {
+    while (true)
+    {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_queued.wait(lock, [this]()
+        {
+          return m_stop || !m_tasks.empty();
+        });
+        // queued tasks still run after Stop, someone may be waiting on them
+        if (m_tasks.empty())
+          break;
+        task = m_tasks.front();
+        m_tasks.pop_front();
+      }
+      task();
+    }
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace NextPVR
+{
+  /**
+   * Small fixed set of threads running queued tasks in order. Without
+   * threads, tasks run on the thread submitting them.
+   */
+  class WorkerPool
+  {
+    public:
+      WorkerPool(void) : m_stop(false) {}
+      virtual ~WorkerPool() { Stop(); }
+
+      void Start(int workers);
+
+      /**
+       * Runs the tasks still queued, then ends the threads
+       */
+      void Stop();
+
+      void Submit(const std::function<void()> &task);
+
+    private:
+      void WorkerProc();
+
+      std::vector<std::thread> m_threads;
+      std::mutex m_mutex;
+      std::condition_variable m_queued;
+      std::deque<std::function<void()>> m_tasks;
+      bool m_stop;
+  };
+}
@@ -0,0 +1,389 @@
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <stdlib.h>
+
+#include "XmlReader.h"
+
+namespace NextPVR
+{
+  struct xmlEntity
+  {
+    const char *name;
+    char value;
+  };
+
+  static const xmlEntity xmlEntities[] =
+  {
+    { "amp", '&' },
+    { "lt", '<' },
+    { "gt", '>' },
+    { "quot", '"' },
+    { "apos", '\'' }
+  };
+
+  static bool IsSpace(char c)
+  {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  }
+
+  static void AppendUtf8(std::string &text, unsigned long code)
+  {
+    if (code < 0x80)
+    {
+      text += (char) code;
+    }
+    else if (code < 0x800)
+    {
+      text += (char) (0xC0 | (code >> 6));
+      text += (char) (0x80 | (code & 0x3F));
+    }
+    else if (code < 0x10000)
+    {
+      text += (char) (0xE0 | (code >> 12));
+      text += (char) (0x80 | ((code >> 6) & 0x3F));
+      text += (char) (0x80 | (code & 0x3F));
+    }
+    else
+    {
+      text += (char) (0xF0 | (code >> 18));
+      text += (char) (0x80 | ((code >> 12) & 0x3F));
+      text += (char) (0x80 | ((code >> 6) & 0x3F));
+      text += (char) (0x80 | (code & 0x3F));
+    }
+  }
+
+  bool XmlView::Equals(const char *text) const
+  {
+    size_t textLength = strlen(text);
+    return textLength == length && memcmp(data, text, length) == 0;
+  }
+
+  std::string XmlView::Text() const
+  {
+    std::string text;
+    TextTo(text);
+    return text;
+  }
+
+  void XmlView::TextTo(std::string &text) const
+  {
+    text.clear();
+    text.reserve(length);
+    bool space = false;
+    for (size_t i = 0; i < length; i++)
+    {
+      char c = data[i];
+      if (!cdata && IsSpace(c))
+      {
+        space = true;
+        continue;
+      }
+      if (space && !text.empty())
+        text += ' ';
+      space = false;
+
+      if (c == '&' && !cdata)
+      {
+        const char *semicolon = (const char *) memchr(data + i, ';', std::min(length - i, (size_t) 12));
+        if (semicolon != nullptr)
+        {
+          std::string name(data + i + 1, semicolon);
+          bool decoded = false;
+          if (name.size() > 1 && name[0] == '#')
+          {
+            unsigned long code = (name[1] == 'x' || name[1] == 'X') ? strtoul(name.c_str() + 2, nullptr, 16) : strtoul(name.c_str() + 1, nullptr, 10);
+            AppendUtf8(text, code);
+            decoded = true;
+          }
+          for (const xmlEntity &entity : xmlEntities)
+          {
+            if (!decoded && name == entity.name)
+            {
+              text += entity.value;
+              decoded = true;
+            }
+          }
+          if (decoded)
+          {
+            i = semicolon - data;
+            continue;
+          }
+        }
+      }
+      text += c;
+    }
+  }
+
+  void XmlView::CopyTo(char *buffer, size_t size) const
+  {
+    std::string text = Text();
+    strncpy(buffer, text.c_str(), size - 1);
+    buffer[size - 1] = '\0';
+  }
+
+  int64_t XmlView::ToInt64() const
+  {
+    size_t i = 0;
+    while (i < length && IsSpace(data[i]))
+      i++;
+    bool negative = false;
+    if (i < length && (data[i] == '-' || data[i] == '+'))
+    {
+      negative = data[i] == '-';
+      i++;
+    }
+    int64_t value = 0;
+    while (i < length && data[i] >= '0' && data[i] <= '9')
+    {
+      value = value * 10 + (data[i] - '0');
+      i++;
+    }
+    return negative ? -value : value;
+  }
+
+  XmlReader::XmlReader(const char *data, size_t length)
+  {
+    m_pos = data;
+    m_end = data + length;
+    m_node = NodeNone;
+    m_attributes = nullptr;
+    m_attributesEnd = nullptr;
+    m_depth = 0;
+    m_nodeDepth = 0;
+    m_closePending = false;
+  }
+
+  XmlReader::XmlReader(const std::string &document) : XmlReader(document.c_str(), document.size())
+  {
+  }
+
+  bool XmlReader::SkipPast(const char *marker)
+  {
+    size_t markerLength = strlen(marker);
+    const char *found = std::search(m_pos, m_end, marker, marker + markerLength);
+    if (found == m_end)
+      return false;
+    m_pos = found + markerLength;
+    return true;
+  }
+
+  bool XmlReader::Next()
+  {
+    if (m_closePending)
+    {
+      // the end of a <tag/>
+      m_closePending = false;
+      m_node = NodeEnd;
+      m_nodeDepth = m_depth--;
+      return true;
+    }
+
+    while (m_pos < m_end)
+    {
+      if (*m_pos != '<')
+      {
+        const char *start = m_pos;
+        m_pos = (const char *) memchr(m_pos, '<', m_end - m_pos);
+        if (m_pos == nullptr)
+          m_pos = m_end;
+        // white space between tags is not text
+        if (std::all_of(start, m_pos, IsSpace))
+          continue;
+        m_value.data = start;
+        m_value.length = m_pos - start;
+        m_value.cdata = false;
+        m_node = NodeText;
+        m_nodeDepth = m_depth;
+        return true;
+      }
+
+      size_t left = m_end - m_pos;
+      if (left >= 2 && m_pos[1] == '?')
+      {
+        if (!SkipPast("?>"))
+          break;
+      }
+      else if (left >= 4 && strncmp(m_pos, "<!--", 4) == 0)
+      {
+        if (!SkipPast("-->"))
+          break;
+      }
+      else if (left >= 9 && strncmp(m_pos, "<![CDATA[", 9) == 0)
+      {
+        const char *start = m_pos + 9;
+        m_pos = start;
+        if (!SkipPast("]]>"))
+          break;
+        m_value.data = start;
+        m_value.length = m_pos - 3 - start;
+        m_value.cdata = true;
+        m_node = NodeText;
+        m_nodeDepth = m_depth;
+        return true;
+      }
+      else if (left >= 2 && m_pos[1] == '!')
+      {
+        if (!SkipPast(">"))
+          break;
+      }
+      else if (left >= 2 && m_pos[1] == '/')
+      {
+        const char *name = m_pos + 2;
+        const char *close = (const char *) memchr(name, '>', m_end - name);
+        if (close == nullptr)
+          break;
+        const char *nameEnd = name;
+        while (nameEnd < close && !IsSpace(*nameEnd))
+          nameEnd++;
+        m_name.data = name;
+        m_name.length = nameEnd - name;
+        m_pos = close + 1;
+        m_node = NodeEnd;
+        m_nodeDepth = m_depth--;
+        return true;
+      }
+      else
+      {
+        const char *name = m_pos + 1;
+        const char *p = name;
+        while (p < m_end && !IsSpace(*p) && *p != '>' && *p != '/')
+          p++;
+        m_name.data = name;
+        m_name.length = p - name;
+        m_attributes = p;
+        // the tag ends at the first > outside an attribute value
+        char quote = 0;
+        while (p < m_end && (quote != 0 || *p != '>'))
+        {
+          if (quote != 0)
+          {
+            if (*p == quote)
+              quote = 0;
+          }
+          else if (*p == '"' || *p == '\'')
+          {
+            quote = *p;
+          }
+          p++;
+        }
+        if (p == m_end)
+          break;
+        m_closePending = p[-1] == '/';
+        m_attributesEnd = m_closePending ? p - 1 : p;
+        m_pos = p + 1;
+        m_node = NodeStart;
+        m_nodeDepth = ++m_depth;
+        return true;
+      }
+    }
+    m_pos = m_end;
+    m_node = NodeDone;
+    return false;
+  }
+
+  bool XmlReader::Attribute(const char *name, XmlView &value) const
+  {
+    if (m_node != NodeStart)
+      return false;
+    size_t nameLength = strlen(name);
+    const char *p = m_attributes;
+    while (p < m_attributesEnd)
+    {
+      while (p < m_attributesEnd && IsSpace(*p))
+        p++;
+      const char *attributeName = p;
+      while (p < m_attributesEnd && *p != '=' && !IsSpace(*p))
+        p++;
+      const char *attributeNameEnd = p;
+      while (p < m_attributesEnd && (IsSpace(*p) || *p == '='))
+        p++;
+      if (p >= m_attributesEnd || (*p != '"' && *p != '\''))
+        return false;
+      char quote = *p++;
+      const char *attributeValue = p;
+      while (p < m_attributesEnd && *p != quote)
+        p++;
+      if ((size_t) (attributeNameEnd - attributeName) == nameLength && strncmp(attributeName, name, nameLength) == 0)
+      {
+        value.data = attributeValue;
+        value.length = p - attributeValue;
+        value.cdata = false;
+        return true;
+      }
+      p++;
+    }
+    return false;
+  }
+
+  bool XmlReader::NextChild(int parentDepth)
+  {
+    while (Next())
+    {
+      if (m_node == NodeStart && m_nodeDepth == parentDepth + 1)
+        return true;
+      if (m_node == NodeEnd && m_nodeDepth == parentDepth)
+        return false;
+    }
+    return false;
+  }
+
+  void XmlReader::Skip()
+  {
+    if (m_node != NodeStart)
+      return;
+    int depth = m_nodeDepth;
+    while (Next())
+    {
+      if (m_node == NodeEnd && m_nodeDepth == depth)
+        return;
+    }
+  }
+
+  XmlView XmlReader::ReadText()
+  {
+    XmlView text;
+    if (m_node != NodeStart)
+      return text;
+    int depth = m_nodeDepth;
+    while (Next())
+    {
+      if (m_node == NodeText && m_nodeDepth == depth && text.data == nullptr)
+        text = m_value;
+      else if (m_node == NodeEnd && m_nodeDepth == depth)
+        break;
+    }
+    return text;
+  }
+
+  bool XmlReader::Find(const char *name)
+  {
+    while (Next())
+    {
+      if (m_node == NodeStart && m_name.Equals(name))
+        return true;
+    }
+    return false;
+  }
+}
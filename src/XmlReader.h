@@ -0,0 +1,145 @@
+#pragma once
+/*
+ *      Copyright (C) 2005-2011 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+#include <stdint.h>
+
+namespace NextPVR
+{
+  /**
+   * Part of the response buffer, not copied. Text is decoded only when it
+   * is asked for.
+   */
+  struct XmlView
+  {
+    XmlView(void) : data(nullptr), length(0), cdata(false) {}
+
+    bool Empty() const { return length == 0; }
+    bool Equals(const char *text) const;
+
+    /**
+     * @return the text with entities decoded and white space condensed
+     * the way TinyXML does by default
+     */
+    std::string Text() const;
+
+    /**
+     * Same as Text() into text, reusing its memory
+     */
+    void TextTo(std::string &text) const;
+
+    /**
+     * Copies Text() into a fixed size buffer, always terminated
+     */
+    void CopyTo(char *buffer, size_t size) const;
+
+    int ToInt() const { return (int) ToInt64(); }
+    int64_t ToInt64() const;
+
+    const char *data;
+    size_t length;
+    bool cdata;
+  };
+
+  /**
+   * Pull parser over a backend response. Next() steps through start tags,
+   * end tags and text in document order without building a tree, so a
+   * record can be read in one pass over its fields.
+   */
+  class XmlReader
+  {
+    public:
+      enum eNode
+      {
+        NodeNone,
+        NodeStart,
+        NodeEnd,
+        NodeText,
+        NodeDone
+      };
+
+      XmlReader(const char *data, size_t length);
+      XmlReader(const std::string &document);
+
+      /**
+       * Moves to the next start tag, end tag or text
+       * @return false at the end of the document or on malformed input
+       */
+      bool Next();
+
+      eNode Node() const { return m_node; }
+
+      /**
+       * Name of the current start or end tag
+       */
+      const XmlView &Name() const { return m_name; }
+
+      /**
+       * Current text
+       */
+      const XmlView &Value() const { return m_value; }
+
+      /**
+       * Nesting of the current tag, 1 for the root element
+       */
+      int Depth() const { return m_nodeDepth; }
+
+      /**
+       * Looks up an attribute of the current start tag
+       */
+      bool Attribute(const char *name, XmlView &value) const;
+
+      /**
+       * Moves to the next start tag of a child of the element at parentDepth
+       * @return false once that element ends
+       */
+      bool NextChild(int parentDepth);
+
+      /**
+       * From a start tag, moves past the end of its element
+       */
+      void Skip();
+
+      /**
+       * From a start tag, reads the text of its element and moves past its end
+       */
+      XmlView ReadText();
+
+      /**
+       * Moves to the next start tag named name, at any depth
+       */
+      bool Find(const char *name);
+
+    private:
+      bool SkipPast(const char *marker);
+
+      const char *m_pos;
+      const char *m_end;
+      eNode m_node;
+      XmlView m_name;
+      XmlView m_value;
+      const char *m_attributes;
+      const char *m_attributesEnd;
+      int m_depth;
+      int m_nodeDepth;
+      bool m_closePending;
+  };
+}
@@ -0,0 +1,71 @@
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include "GrowthTracker.h"
+#include <thread>
+
+using namespace timeshift;
+using namespace ADDON;
+
+GrowthTracker::GrowthTracker(const std::string &path, int64_t length) :
+  m_path(path), m_canProbe(true), m_length(length), m_probes(0)
+{
+  m_isHttp = path.rfind("http", 0) == 0;
+  // a stat of a local or smb file is cheap, an HTTP probe is a request
+  m_probeInterval = m_isHttp ? 1000 : 200;
+  m_lastProbe = std::chrono::steady_clock::now() - std::chrono::milliseconds(m_probeInterval);
+}
+
+int64_t GrowthTracker::Probe()
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (now - m_lastProbe < std::chrono::milliseconds(m_probeInterval))
+    return m_length;
+
+  m_lastProbe = now;
+  m_probes++;
+  struct __stat64 st;
+  if (XBMC->StatFile(m_path.c_str(), &st) != 0)
+  {
+    XBMC->Log(LOG_DEBUG, "%s:%d: cannot stat %s", __FUNCTION__, __LINE__, m_path.c_str());
+    m_canProbe = false;
+  }
+  else if (st.st_size > m_length)
+  {
+    XBMC->Log(LOG_DEBUG, "%s:%d: %lld -> %lld after %d probes", __FUNCTION__, __LINE__, m_length, (int64_t) st.st_size, m_probes);
+    m_length = st.st_size;
+    m_probes = 0;
+  }
+  return m_length;
+}
+
+bool GrowthTracker::WaitForGrowth(int64_t position, int timeout)
+{
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+  while (Probe() <= position)
+  {
+    if (!m_canProbe)
+      return false;
+    if (std::chrono::steady_clock::now() >= end)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(m_probeInterval));
+  }
+  return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include <string>
+#include <chrono>
+#include "Buffer.h"
+
+namespace timeshift {
+
+  /**
+   * Follows the size of a recording that is still being written. Native
+   * paths are stat'ed, HTTP urls are probed at most once per interval so
+   * catching up with the live edge does not hammer the backend.
+   */
+  class GrowthTracker
+  {
+  public:
+    GrowthTracker(const std::string &path, int64_t length);
+
+    /**
+     * @return whether the file is read over HTTP, where the handle has to
+     * be re-opened to see data past the length it was opened with
+     */
+    bool IsHttp() const { return m_isHttp; }
+
+    /**
+     * @return false when the server does not answer stat requests, the
+     * caller has to re-open the file to find out the new length
+     */
+    bool CanProbe() const { return m_canProbe; }
+
+    /**
+     * @return the largest length seen so far
+     */
+    int64_t Length() const { return m_length; }
+
+    /**
+     * Records a length learnt some other way, e.g. from a re-opened handle
+     */
+    void Update(int64_t length) { if (length > m_length) m_length = length; }
+
+    /**
+     * Checks the current size of the file, rate limited
+     * @return the largest length seen so far
+     */
+    int64_t Probe();
+
+    /**
+     * Waits up to timeout ms for the file to grow past position
+     * @return whether there is data past position
+     */
+    bool WaitForGrowth(int64_t position, int timeout);
+
+  private:
+    std::string m_path;
+    bool m_isHttp;
+    bool m_canProbe;
+    int64_t m_length;
+    int m_probeInterval;
+    std::chrono::steady_clock::time_point m_lastProbe;
+    int m_probes;
+  };
+}
@@ -0,0 +1,150 @@
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include "NativeFile.h"
+
+#if !defined(TARGET_WINDOWS)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+using namespace timeshift;
+using namespace ADDON;
+
+// how far ahead of the read position the kernel is asked to prefetch
+#define ADVISE_WINDOW (8 * 1024 * 1024)
+
+bool NativeFile::IsNativePath(const std::string &path)
+{
+#if defined(TARGET_WINDOWS)
+  return false;
+#else
+  return !path.empty() && path[0] == '/';
+#endif
+}
+
+bool NativeFile::Open(const std::string &path)
+{
+  Close();
+#if defined(TARGET_WINDOWS)
+  return false;
+#else
+  m_fd = open(path.c_str(), O_RDONLY);
+  if (m_fd == -1)
+  {
+    XBMC->Log(LOG_DEBUG, "%s:%d: cannot open %s", __FUNCTION__, __LINE__, path.c_str());
+    return false;
+  }
+#if defined(POSIX_FADV_SEQUENTIAL)
+  posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  m_position = 0;
+  m_adviseEnd = 0;
+  m_bytesRead = 0;
+  Advise();
+  XBMC->Log(LOG_DEBUG, "%s:%d: direct read %s", __FUNCTION__, __LINE__, path.c_str());
+  return true;
+#endif
+}
+
+void NativeFile::Close()
+{
+#if !defined(TARGET_WINDOWS)
+  if (m_fd != -1)
+  {
+    XBMC->Log(LOG_DEBUG, "%s:%d: %lld bytes read", __FUNCTION__, __LINE__, m_bytesRead);
+    close(m_fd);
+    m_fd = -1;
+  }
+#endif
+}
+
+void NativeFile::Advise()
+{
+#if defined(POSIX_FADV_WILLNEED)
+  if (m_position + ADVISE_WINDOW / 2 < m_adviseEnd)
+    return;
+  int64_t start = m_position > m_adviseEnd ? m_position : m_adviseEnd;
+  posix_fadvise(m_fd, start, m_position + ADVISE_WINDOW - start, POSIX_FADV_WILLNEED);
+  m_adviseEnd = m_position + ADVISE_WINDOW;
+#endif
+}
+
+int NativeFile::Read(byte *buffer, size_t length)
+{
+#if defined(TARGET_WINDOWS)
+  return 0;
+#else
+  if (m_fd == -1)
+    return 0;
+  ssize_t dataRead;
+  do
+  {
+    dataRead = pread(m_fd, buffer, length, m_position);
+  } while (dataRead == -1 && errno == EINTR);
+  if (dataRead <= 0)
+    return 0;
+  m_position += dataRead;
+  m_bytesRead += dataRead;
+  Advise();
+  return (int) dataRead;
+#endif
+}
+
+int64_t NativeFile::Seek(int64_t position, int whence)
+{
+  int64_t newPosition;
+  switch (whence)
+  {
+  case SEEK_SET:
+    newPosition = position;
+    break;
+  case SEEK_CUR:
+    newPosition = m_position + position;
+    break;
+  case SEEK_END:
+    newPosition = Length() + position;
+    break;
+  default:
+    // SEEK_POSSIBLE
+    return 1;
+  }
+  if (newPosition < 0)
+    return -1;
+  m_position = newPosition;
+  // a jump invalidates the prefetched window
+  m_adviseEnd = m_position;
+  Advise();
+  return m_position;
+}
+
+int64_t NativeFile::Length() const
+{
+#if defined(TARGET_WINDOWS)
+  return 0;
+#else
+  struct stat st;
+  if (m_fd == -1 || fstat(m_fd, &st) != 0)
+    return 0;
+  return st.st_size;
+#endif
+}
@@ -0,0 +1,71 @@
+#pragma once
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include <string>
+#include "Buffer.h"
+
+namespace timeshift {
+
+  /**
+   * Reads a recording on a local or NFS mounted path with pread straight
+   * into the caller's buffer, bypassing Kodi's file layer. The kernel is
+   * told the access is sequential and asked to prefetch the next window.
+   */
+  class NativeFile
+  {
+  public:
+    NativeFile() : m_fd(-1), m_position(0), m_adviseEnd(0), m_bytesRead(0) {}
+    ~NativeFile() { Close(); }
+
+    /**
+     * @return whether path is a plain file system path, not a Kodi url
+     */
+    static bool IsNativePath(const std::string &path);
+
+    bool Open(const std::string &path);
+    void Close();
+
+    /**
+     * @return the number of bytes read, 0 at the end of the file
+     */
+    int Read(byte *buffer, size_t length);
+
+    int64_t Seek(int64_t position, int whence);
+
+    int64_t Position() const { return m_position; }
+
+    /**
+     * @return the current size of the file, it may still be growing
+     */
+    int64_t Length() const;
+
+  private:
+    /**
+     * Hints the kernel to fetch the window after the read position
+     */
+    void Advise();
+
+    int m_fd;
+    int64_t m_position;
+    int64_t m_adviseEnd;
+    int64_t m_bytesRead;
+  };
+}
@@ -0,0 +1,182 @@
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include "Prefetcher.h"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+using namespace timeshift;
+using namespace ADDON;
+
+// regions kept in memory, the oldest is dropped first
+#define PREFETCH_MAX_REGIONS 4
+
+void Prefetcher::Open(const std::string &url)
+{
+  Close();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_url = url;
+  m_regions.clear();
+  m_stop = false;
+  m_thread = std::thread([this]()
+  {
+    FetchProc();
+  });
+}
+
+void Prefetcher::Close()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stop = true;
+    m_queued.notify_all();
+  }
+  if (m_thread.joinable())
+    m_thread.join();
+  if (m_handle != nullptr)
+  {
+    XBMC->CloseFile(m_handle);
+    m_handle = nullptr;
+  }
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_regions.clear();
+}
+
+void Prefetcher::Queue(int64_t offset, int length)
+{
+  if (offset < 0)
+  {
+    length += (int) offset;
+    offset = 0;
+  }
+  if (length <= 0)
+    return;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_stop)
+    return;
+  for (const region &r : m_regions)
+  {
+    if (r.offset <= offset && offset + length <= r.offset + r.length)
+      return;
+  }
+  while (m_regions.size() >= PREFETCH_MAX_REGIONS)
+  {
+    m_regions.pop_front();
+  }
+  region newRegion;
+  newRegion.offset = offset;
+  newRegion.length = length;
+  newRegion.ready = false;
+  m_regions.push_back(newRegion);
+  m_queued.notify_one();
+}
+
+const Prefetcher::region *Prefetcher::Find(int64_t offset) const
+{
+  for (const region &r : m_regions)
+  {
+    if (r.ready && r.offset <= offset && offset < r.offset + (int64_t) r.data.size())
+      return &r;
+  }
+  return nullptr;
+}
+
+bool Prefetcher::Contains(int64_t offset) const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return Find(offset) != nullptr;
+}
+
+int64_t Prefetcher::RegionEnd(int64_t offset) const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  const region *r = Find(offset);
+  if (r == nullptr)
+    return -1;
+  return r->offset + r->data.size();
+}
+
+int Prefetcher::Read(int64_t offset, byte *buffer, size_t length)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  const region *r = Find(offset);
+  if (r == nullptr)
+    return 0;
+  size_t start = (size_t) (offset - r->offset);
+  size_t count = std::min(length, r->data.size() - start);
+  memcpy(buffer, r->data.data() + start, count);
+  return (int) count;
+}
+
+void Prefetcher::FetchProc()
+{
+  while (true)
+  {
+    int64_t offset;
+    int length;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_queued.wait(lock, [this]()
+      {
+        return m_stop || std::any_of(m_regions.begin(), m_regions.end(), [](const region &r) { return !r.ready; });
+      });
+      if (m_stop)
+        break;
+      std::list<region>::iterator it = std::find_if(m_regions.begin(), m_regions.end(), [](const region &r) { return !r.ready; });
+      offset = it->offset;
+      length = it->length;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (m_handle == nullptr)
+    {
+      m_handle = XBMC->OpenFile(m_url.c_str(), READ_NO_CACHE);
+    }
+    std::vector<byte> data(length);
+    int filled = 0;
+    if (m_handle != nullptr && XBMC->SeekFile(m_handle, offset, SEEK_SET) == offset)
+    {
+      while (filled < length)
+      {
+        ssize_t dataRead = XBMC->ReadFile(m_handle, data.data() + filled, length - filled);
+        if (dataRead <= 0)
+          break;
+        filled += (int) dataRead;
+      }
+    }
+    data.resize(filled);
+    XBMC->Log(LOG_DEBUG, "%s:%d: %lld %d bytes in %d ms", __FUNCTION__, __LINE__, offset, filled,
+      (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (region &r : m_regions)
+    {
+      // the region may have been dropped while fetching
+      if (!r.ready && r.offset == offset && r.length == length)
+      {
+        r.data.swap(data);
+        r.ready = true;
+        break;
+      }
+    }
+  }
+}
@@ -0,0 +1,87 @@
+#pragma once
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include <string>
+#include <vector>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Buffer.h"
+
+namespace timeshift {
+
+  /**
+   * Fetches regions of a recording that playback is expected to jump to
+   * (the resume point, the end of commercial breaks) on its own handle,
+   * so the jump is served from memory instead of a cold read.
+   */
+  class Prefetcher
+  {
+  public:
+    Prefetcher() : m_handle(nullptr), m_stop(true) {}
+    ~Prefetcher() { Close(); }
+
+    void Open(const std::string &url);
+    void Close();
+
+    /**
+     * Asks for length bytes from offset to be fetched in the background
+     */
+    void Queue(int64_t offset, int length);
+
+    /**
+     * @return whether offset lies in a fetched region
+     */
+    bool Contains(int64_t offset) const;
+
+    /**
+     * @return the end of the fetched region containing offset, -1 if none
+     */
+    int64_t RegionEnd(int64_t offset) const;
+
+    /**
+     * Copies fetched data at offset
+     * @return the number of bytes copied, 0 when offset is not fetched
+     */
+    int Read(int64_t offset, byte *buffer, size_t length);
+
+  private:
+    struct region
+    {
+      int64_t offset;
+      int length;
+      std::vector<byte> data;
+      bool ready;
+    };
+
+    void FetchProc();
+    const region *Find(int64_t offset) const;
+
+    std::string m_url;
+    void *m_handle;
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queued;
+    std::list<region> m_regions;
+    bool m_stop;
+  };
+}
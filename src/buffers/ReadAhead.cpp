@@ -0,0 +1,254 @@
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include "ReadAhead.h"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+using namespace timeshift;
+using namespace ADDON;
+
+ReadAhead::ReadAhead(int blockSize, int blockCount) :
+  m_handle(nullptr), m_position(0), m_bytesBuffered(0), m_generation(0),
+  m_eof(false), m_stop(true), m_refills(0), m_refillTime(0), m_maxRefillTime(0), m_stalls(0)
+{
+  m_blocks.resize(blockCount);
+  for (block &b : m_blocks)
+  {
+    b.data.resize(blockSize);
+    b.length = 0;
+    b.consumed = 0;
+  }
+  XBMC->Log(LOG_NOTICE, "ReadAhead created! %d x %d", blockCount, blockSize);
+}
+
+ReadAhead::~ReadAhead()
+{
+  Stop();
+}
+
+void ReadAhead::Start(void *handle)
+{
+  Stop();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_handle = handle;
+  m_position = XBMC->GetFilePosition(handle);
+  m_filled.clear();
+  m_free.clear();
+  for (block &b : m_blocks)
+  {
+    m_free.push_back(&b);
+  }
+  m_bytesBuffered = 0;
+  m_generation++;
+  m_eof = false;
+  m_stop = false;
+  m_refills = 0;
+  m_refillTime = 0;
+  m_maxRefillTime = 0;
+  m_stalls = 0;
+  m_thread = std::thread([this]()
+  {
+    FillProc();
+  });
+}
+
+void ReadAhead::Stop()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stop = true;
+    m_dataReady.notify_all();
+    m_spaceReady.notify_all();
+  }
+  if (m_thread.joinable())
+  {
+    m_thread.join();
+    XBMC->Log(LOG_INFO, "ReadAhead refills %lld avg %d ms max %d ms stalls %d", m_refills, RefillLatency(), m_maxRefillTime, m_stalls);
+  }
+  m_handle = nullptr;
+}
+
+void ReadAhead::FillProc()
+{
+  while (true)
+  {
+    block *b;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_spaceReady.wait(lock, [this]() { return m_stop || (!m_free.empty() && !m_eof); });
+      if (m_stop)
+        break;
+      b = m_free.back();
+      m_free.pop_back();
+    }
+
+    std::unique_lock<std::mutex> io(m_ioMutex);
+    int generation;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      generation = m_generation;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ssize_t dataRead = XBMC->ReadFile(m_handle, b->data.data(), b->data.size());
+    int elapsed = (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    io.unlock();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (generation != m_generation || m_stop)
+    {
+      // a seek happened while reading, the data is from the old position
+      m_free.push_back(b);
+      continue;
+    }
+    m_refills++;
+    m_refillTime += elapsed;
+    m_maxRefillTime = std::max(m_maxRefillTime, elapsed);
+    if (dataRead <= 0)
+    {
+      m_free.push_back(b);
+      m_eof = true;
+    }
+    else
+    {
+      b->length = (int) dataRead;
+      b->consumed = 0;
+      m_filled.push_back(b);
+      m_bytesBuffered += dataRead;
+    }
+    m_dataReady.notify_all();
+  }
+}
+
+int ReadAhead::Read(byte *buffer, size_t length, int timeout)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_filled.empty() && !m_eof && !m_stop)
+  {
+    m_stalls++;
+    m_dataReady.wait_for(lock, std::chrono::seconds(timeout), [this]() { return !m_filled.empty() || m_eof || m_stop; });
+  }
+
+  size_t copied = 0;
+  while (copied < length && !m_filled.empty())
+  {
+    block *b = m_filled.front();
+    size_t count = std::min(length - copied, (size_t) (b->length - b->consumed));
+    memcpy(buffer + copied, b->data.data() + b->consumed, count);
+    copied += count;
+    b->consumed += (int) count;
+    if (b->consumed == b->length)
+    {
+      m_filled.pop_front();
+      m_free.push_back(b);
+    }
+  }
+  m_position += copied;
+  m_bytesBuffered -= copied;
+  if (copied != 0)
+  {
+    m_spaceReady.notify_one();
+  }
+  return (int) copied;
+}
+
+int64_t ReadAhead::Seek(int64_t position, int whence)
+{
+  if (whence != SEEK_SET && whence != SEEK_CUR && whence != SEEK_END)
+  {
+    // SEEK_POSSIBLE and friends don't move the handle
+    std::unique_lock<std::mutex> io(m_ioMutex);
+    return XBMC->SeekFile(m_handle, position, whence);
+  }
+
+  std::unique_lock<std::mutex> io(m_ioMutex);
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (whence == SEEK_CUR)
+  {
+    position += m_position;
+    whence = SEEK_SET;
+  }
+  if (whence == SEEK_SET && position == m_position)
+  {
+    return m_position;
+  }
+  m_generation++;
+  while (!m_filled.empty())
+  {
+    m_free.push_back(m_filled.front());
+    m_filled.pop_front();
+  }
+  m_bytesBuffered = 0;
+  m_eof = false;
+  int64_t newPosition = XBMC->SeekFile(m_handle, position, whence);
+  if (newPosition >= 0)
+  {
+    m_position = newPosition;
+  }
+  else
+  {
+    // the handle may have moved, restart from wherever it is
+    m_position = XBMC->GetFilePosition(m_handle);
+  }
+  m_spaceReady.notify_one();
+  return newPosition;
+}
+
+void ReadAhead::Resume()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_eof = false;
+  m_spaceReady.notify_one();
+}
+
+int64_t ReadAhead::Position() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_position;
+}
+
+int64_t ReadAhead::Length() const
+{
+  std::unique_lock<std::mutex> io(m_ioMutex);
+  return XBMC->GetFileLength(m_handle);
+}
+
+int ReadAhead::FillLevel() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_blocks.empty())
+    return 0;
+  return (int) (m_bytesBuffered * 100 / ((int64_t) m_blocks.size() * m_blocks.front().data.size()));
+}
+
+int ReadAhead::RefillLatency() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_refills == 0)
+    return 0;
+  return (int) (m_refillTime / m_refills);
+}
+
+bool ReadAhead::IsEof() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_eof && m_filled.empty();
+}
@@ -0,0 +1,138 @@
+#pragma once
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Buffer.h"
+
+namespace timeshift {
+
+  /**
+   * Reads a file handle ahead of the consumer on a background thread into
+   * a fixed pool of blocks, so a slow SMB or HTTP read does not stall the
+   * demuxer. All access to the handle goes through this class while it is
+   * started.
+   */
+  class ReadAhead
+  {
+  public:
+    ReadAhead(int blockSize, int blockCount);
+    ~ReadAhead();
+
+    /**
+     * Starts filling from the current position of handle
+     */
+    void Start(void *handle);
+
+    /**
+     * Stops the fill thread, the handle is left open
+     */
+    void Stop();
+
+    /**
+     * Copies buffered data, waiting up to timeout seconds for the first block
+     * @return the number of bytes read, 0 at the end of the file
+     */
+    int Read(byte *buffer, size_t length, int timeout);
+
+    /**
+     * Drops the buffered data and moves the handle, waits for at most
+     * the one block read that is in flight
+     * @return the new position
+     */
+    int64_t Seek(int64_t position, int whence);
+
+    /**
+     * Continues filling after the end of the file was hit, for files
+     * that are still growing
+     */
+    void Resume();
+
+    /**
+     * @return the position of the consumer, not of the handle
+     */
+    int64_t Position() const;
+
+    /**
+     * @return the length of the file, asked for under the lock of the handle
+     */
+    int64_t Length() const;
+
+    /**
+     * @return buffered bytes as a percentage of the pool
+     */
+    int FillLevel() const;
+
+    /**
+     * @return the average time in ms the backend took to refill a block
+     */
+    int RefillLatency() const;
+
+    /**
+     * @return whether the fill thread hit the end of the file
+     */
+    bool IsEof() const;
+
+  private:
+    struct block
+    {
+      std::vector<byte> data;
+      int length;
+      int consumed;
+    };
+
+    void FillProc();
+
+    void *m_handle;
+    std::thread m_thread;
+
+    /**
+     * Guards the queues and counters, m_ioMutex guards m_handle and is
+     * always taken first
+     */
+    mutable std::mutex m_mutex;
+    mutable std::mutex m_ioMutex;
+    std::condition_variable m_dataReady;
+    std::condition_variable m_spaceReady;
+
+    std::vector<block> m_blocks;
+    std::vector<block*> m_free;
+    std::deque<block*> m_filled;
+
+    int64_t m_position;
+    int64_t m_bytesBuffered;
+
+    /**
+     * Bumped on every seek so a block read before it is discarded
+     */
+    int m_generation;
+    bool m_eof;
+    bool m_stop;
+
+    int64_t m_refills;
+    int64_t m_refillTime;
+    int m_maxRefillTime;
+    int m_stalls;
+  };
+}
@@ -20,15 +20,35 @@
 */
 
 #include "RecordingBuffer.h"
+#include <cstring>
+#include <algorithm>
 
 using namespace timeshift;
 
+// how long Read waits for an in-progress recording to grow, in ms
+#define GROWTH_TIMEOUT 5000
+
+// seconds of a resume point or break end that are prefetched
+#define PREFETCH_SECONDS 4
+#define PREFETCH_MAX_BYTES (16 * 1024 * 1024)
+// a seek lands a little before the target while the demuxer searches for it
+#define PREFETCH_BEFORE (TS_PACKET_SIZE * 2048)
+// a warm open of the next episode is kept when playback stops this close to the end
+#define WARM_KEEP_BYTES (4 * 1024 * 1024)
+// bytes of the next episode read by its warm open
+#define WARM_PREFETCH_BYTES (2 * 1024 * 1024)
+// how close playback gets to a commercial break before its end is prefetched, in ms
+#define EDL_LOOKAHEAD 30000
+
 PVR_ERROR RecordingBuffer::GetStreamTimes(PVR_STREAM_TIMES *stimes)
 {
   stimes->startTime = 0;
   stimes->ptsStart = 0;
   stimes->ptsBegin = 0;
-  stimes->ptsEnd = ((int64_t ) Duration() ) * DVD_TIME_BASE;
+  if (m_index.IsReady())
+    stimes->ptsEnd = m_index.Duration() * DVD_TIME_BASE / 1000;
+  else
+    stimes->ptsEnd = ((int64_t ) Duration() ) * DVD_TIME_BASE;
   return PVR_ERROR_NO_ERROR;
 }
 
@@ -53,8 +73,60 @@ int RecordingBuffer::Duration(void)
   }
 }
 
+std::string RecordingBuffer::ResolvePath(const std::string &inputUrl, const char *hostFilename)
+{
+  if (hostFilename[0] != 0)
+  {
+    char strDirectory [PVR_ADDON_URL_STRING_LENGTH];
+    strcpy(strDirectory,hostFilename);
+    int i = 0;
+    int j = 0;
+    for(; i <= strlen(hostFilename); i++, j++)
+    {
+      if (hostFilename[i] == '\\')
+      {
+        if (i==0 && hostFilename[1] == '\\')
+        {
+          strcpy(strDirectory,"smb://");
+          i = 1;
+          j = 5;
+        }
+        else
+        {
+          strDirectory[j] = '/';
+        }
+      }
+      else
+      {
+          strDirectory[j] = hostFilename[i];
+      }
+    }
+    if ( XBMC->FileExists(strDirectory,false))
+    {
+      XBMC->Log(LOG_DEBUG, "Native playback %s", strDirectory);
+      return strDirectory;
+    }
+  }
+  return inputUrl;
+}
+
 bool RecordingBuffer::Open(const std::string inputUrl,const PVR_RECORDING &recording)
 {
+  m_prefetcher.Close();
+  m_prefetching = false;
+  m_prefetchServing = false;
+  m_edl.clear();
+  m_nextBreak = 0;
+  m_recordingId = recording.strRecordingId;
+  m_openTime = std::chrono::steady_clock::now();
+  m_firstSeek = true;
+  m_timingSeek = false;
+  m_index.Close();
+  StopReadAhead();
+  delete m_growth;
+  m_growth = nullptr;
+  delete m_nativeFile;
+  m_nativeFile = nullptr;
   m_Duration = recording.iDuration;
   if (!XBMC->GetSetting("chunkrecording", &m_chunkSize))
   {
@@ -70,57 +142,364 @@ bool RecordingBuffer::Open(const std::string inputUrl,const PVR_RECORDING &recor
   {
     m_isRecording.store(false);
   }
-  if (recording.strDirectory[0] != 0)
+  void *warmHandle = nullptr;
+  m_warmData.clear();
+  if (m_managedReads && m_warmOpen.Take(recording.strRecordingId, m_openUrl, warmHandle, m_warmData))
   {
-    char strDirectory [PVR_ADDON_URL_STRING_LENGTH];
-    strcpy(strDirectory,recording.strDirectory);
-    int i = 0;
-    int j = 0;
-    for(; i <= strlen(recording.strDirectory); i++, j++)
+    XBMC->Log(LOG_DEBUG, "Warm open %s %d", m_openUrl.c_str(), (int) m_warmData.size());
+  }
+  else
+  {
+    m_openUrl = ResolvePath(inputUrl, recording.strDirectory);
+  }
+  if (m_managedReads && NativeFile::IsNativePath(m_openUrl))
+  {
+    bool directRead;
+    if (!XBMC->GetSetting("directread", &directRead))
     {
-      if (recording.strDirectory[i] == '\\')
+      directRead = false;
+    }
+    if (directRead)
+    {
+      m_nativeFile = new NativeFile();
+      if (m_nativeFile->Open(m_openUrl))
       {
-        if (i==0 && recording.strDirectory[1] == '\\')
-        {
-          strcpy(strDirectory,"smb://");
-          i = 1;
-          j = 5;
-        }
-        else
-        {
-          strDirectory[j] = '/';
-        }
+        m_active = true;
+        m_startTime = time(nullptr);
+        CloseHandle(warmHandle);
       }
       else
       {
-          strDirectory[j] = recording.strDirectory[i];
+        delete m_nativeFile;
+        m_nativeFile = nullptr;
       }
     }
-    if ( XBMC->FileExists(strDirectory,false))
+  }
+  if (m_nativeFile == nullptr)
+  {
+    if (warmHandle != nullptr)
     {
-      XBMC->Log(LOG_DEBUG, "Native playback %s", strDirectory);
-      return Buffer::Open(std::string(strDirectory),0);
+      m_inputHandle = warmHandle;
+      m_active = true;
+      m_startTime = time(nullptr);
+    }
+    else if (!Buffer::Open(m_openUrl,0))
+    {
+      m_warmData.clear();
+      return false;
     }
   }
-  return Buffer::Open(inputUrl,0);
+  if (!m_warmData.empty())
+  {
+    // the first bytes were read by the warm open, the input continues after them
+    m_prefetchServing = true;
+    m_prefetchPosition = 0;
+    m_prefetchEnd = m_warmData.size();
+    if (m_nativeFile != nullptr)
+      m_nativeFile->Seek(m_prefetchEnd, SEEK_SET);
+  }
+  if (m_managedReads && m_isRecording.load())
+  {
+    m_growth = new GrowthTracker(m_openUrl, Length());
+  }
+  else if (m_managedReads)
+  {
+    bool indexRecordings;
+    if (!XBMC->GetSetting("recordingindex", &indexRecordings))
+    {
+      indexRecordings = false;
+    }
+    if (indexRecordings)
+    {
+      m_index.Open(recording.strRecordingId, m_openUrl, Length());
+    }
+  }
+  StartReadAhead();
+  if (m_managedReads && !m_isRecording.load())
+  {
+    bool prefetch;
+    if (!XBMC->GetSetting("prefetch", &prefetch))
+    {
+      prefetch = false;
+    }
+    if (prefetch)
+    {
+      m_prefetching = true;
+      m_prefetcher.Open(m_openUrl);
+      if (recording.iLastPlayedPosition > 0)
+      {
+        // Kodi seeks to the resume point straight after opening
+        PrefetchAt((int64_t) recording.iLastPlayedPosition * 1000);
+      }
+    }
+  }
+  return true;
+}
+
+void RecordingBuffer::Close()
+{
+  if (m_managedReads && (m_inputHandle != nullptr || m_nativeFile != nullptr) && Length() - Position() > WARM_KEEP_BYTES)
+  {
+    // stopped before the end, the next episode is not going to be played
+    m_warmOpen.Discard();
+  }
+  m_warmData.clear();
+  m_prefetcher.Close();
+  m_prefetching = false;
+  m_prefetchServing = false;
+  m_index.Close();
+  StopReadAhead();
+  delete m_growth;
+  m_growth = nullptr;
+  delete m_nativeFile;
+  m_nativeFile = nullptr;
+  Buffer::Close();
+}
+
+bool RecordingBuffer::ReopenAt(int64_t position)
+{
+  if (m_readAhead != nullptr)
+    m_readAhead->Stop();
+  CloseHandle(m_inputHandle);
+  if (!Buffer::Open(m_openUrl,0))
+  {
+    XBMC->Log(LOG_ERROR, "%s:%d: could not re-open %s", __FUNCTION__, __LINE__, m_openUrl.c_str());
+    return false;
+  }
+  if (position != 0)
+    XBMC->SeekFile(m_inputHandle, position, SEEK_SET);
+  if (m_readAhead != nullptr)
+    m_readAhead->Start(m_inputHandle);
+  return true;
+}
+
+void RecordingBuffer::StartReadAhead()
+{
+  int seconds;
+  if (!m_managedReads || m_nativeFile != nullptr || !XBMC->GetSetting("readahead", &seconds) || seconds <= 0)
+    return;
+
+  int64_t bytesPerSecond = BytesPerSecond();
+  int blockSize = m_chunkSize * 1024 * 4;
+  int64_t blocks = seconds * bytesPerSecond / blockSize;
+  if (blocks < 4)
+    blocks = 4;
+  else if (blocks > 512)
+    blocks = 512;
+  XBMC->Log(LOG_DEBUG, "%s:%d: %d seconds at %lld bytes/s", __FUNCTION__, __LINE__, seconds, bytesPerSecond);
+  m_readAhead = new ReadAhead(blockSize, (int) blocks);
+  m_readAhead->Start(m_inputHandle);
+}
+
+int64_t RecordingBuffer::BytesPerSecond()
+{
+  int64_t length = Length();
+  int duration = Duration();
+  if (length > 0 && duration > 0)
+    return length / duration;
+  // UHD sized guess
+  return 2 * 1024 * 1024;
+}
+
+int64_t RecordingBuffer::TimeToOffset(int64_t timeMs)
+{
+  if (m_index.IsReady())
+    return m_index.OffsetAt(timeMs);
+  int duration = Duration();
+  if (duration <= 0)
+    return -1;
+  return Length() * timeMs / ((int64_t) duration * 1000);
+}
+
+void RecordingBuffer::PrefetchAt(int64_t timeMs)
+{
+  int64_t offset = TimeToOffset(timeMs);
+  if (offset < 0)
+    return;
+  int64_t length = PREFETCH_SECONDS * BytesPerSecond();
+  if (length > PREFETCH_MAX_BYTES)
+    length = PREFETCH_MAX_BYTES;
+  offset = (offset / TS_PACKET_SIZE) * TS_PACKET_SIZE - PREFETCH_BEFORE;
+  XBMC->Log(LOG_DEBUG, "%s:%d: %lld ms at %lld", __FUNCTION__, __LINE__, timeMs, offset);
+  m_prefetcher.Queue(offset, (int) length + PREFETCH_BEFORE);
+}
+
+void RecordingBuffer::PreOpen(const std::string &recordingId, const std::string &inputUrl, const std::string &hostFilename)
+{
+  m_warmOpen.Start(recordingId, inputUrl, hostFilename, WARM_PREFETCH_BYTES);
+}
+
+void RecordingBuffer::SetEdl(const std::string &recordingId, const std::vector<std::pair<int, int>> &breaks)
+{
+  if (recordingId != m_recordingId)
+    return;
+  m_edl = breaks;
+  m_nextBreak = 0;
+}
+
+void RecordingBuffer::CheckEdl()
+{
+  if (!m_prefetching || m_nextBreak >= m_edl.size())
+    return;
+  int64_t now;
+  if (m_index.IsReady())
+    now = m_index.TimeAt(Position());
+  else
+    now = Position() * 1000 / BytesPerSecond();
+  while (m_nextBreak < m_edl.size() && m_edl[m_nextBreak].second <= now)
+  {
+    m_nextBreak++;
+  }
+  if (m_nextBreak < m_edl.size() && m_edl[m_nextBreak].first - now < EDL_LOOKAHEAD)
+  {
+    PrefetchAt(m_edl[m_nextBreak].second);
+    m_nextBreak++;
+  }
+}
+
+void RecordingBuffer::ReportSeekTime(bool prefetched)
+{
+  if (!m_timingSeek)
+    return;
+  m_timingSeek = false;
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  int seekTime = (int) std::chrono::duration_cast<std::chrono::milliseconds>(now - m_seekTime).count();
+  if (m_firstSeek)
+  {
+    m_firstSeek = false;
+    int openTime = (int) std::chrono::duration_cast<std::chrono::milliseconds>(now - m_openTime).count();
+    XBMC->Log(LOG_INFO, "%s:%d: resume to first data %d ms (seek %d ms) %s", __FUNCTION__, __LINE__, openTime, seekTime, prefetched ? "prefetched" : "cold");
+  }
+  else
+  {
+    XBMC->Log(LOG_INFO, "%s:%d: skip to first data %d ms %s", __FUNCTION__, __LINE__, seekTime, prefetched ? "prefetched" : "cold");
+  }
+}
+
+int64_t RecordingBuffer::SeekInput(int64_t position, int whence)
+{
+  if (m_nativeFile != nullptr)
+    return m_nativeFile->Seek(position, whence);
+  if (m_readAhead != nullptr)
+    return m_readAhead->Seek(position, whence);
+  return XBMC->SeekFile(m_inputHandle, position, whence);
+}
+
+int64_t RecordingBuffer::Seek(int64_t position, int whence)
+{
+  XBMC->Log(LOG_DEBUG, "Seek: %s:%d  %lld  %lld %lld", __FUNCTION__, __LINE__,position, Position(), Length() );
+  if (whence != SEEK_SET && whence != SEEK_CUR && whence != SEEK_END)
+    return SeekInput(position, whence);
+
+  if (whence == SEEK_CUR)
+  {
+    position += Position();
+    whence = SEEK_SET;
+  }
+  if (m_prefetching)
+  {
+    m_seekTime = std::chrono::steady_clock::now();
+    m_timingSeek = true;
+  }
+  if (whence == SEEK_SET)
+  {
+    int64_t end = -1;
+    if (position >= 0 && position < (int64_t) m_warmData.size())
+      end = m_warmData.size();
+    else if (m_prefetching)
+      end = m_prefetcher.RegionEnd(position);
+    if (end != -1)
+    {
+      // serve the jump from memory, the input catches up behind it
+      m_prefetchServing = true;
+      m_prefetchPosition = position;
+      m_prefetchEnd = end;
+      SeekInput(end, SEEK_SET);
+      return position;
+    }
+  }
+  m_prefetchServing = false;
+  return SeekInput(position, whence);
+}
+
+void RecordingBuffer::StopReadAhead()
+{
+  if (m_readAhead != nullptr)
+  {
+    XBMC->Log(LOG_DEBUG, "%s:%d: fill %d%% refill %d ms", __FUNCTION__, __LINE__, m_readAhead->FillLevel(), m_readAhead->RefillLatency());
+    delete m_readAhead;
+    m_readAhead = nullptr;
+  }
+}
+
+int RecordingBuffer::ReadInput(byte *buffer, size_t length)
+{
+  if (m_nativeFile != nullptr)
+    return m_nativeFile->Read(buffer, length);
+  if (m_readAhead != nullptr)
+    return m_readAhead->Read(buffer, length, m_readTimeout);
+  return (int) XBMC->ReadFile(m_inputHandle, buffer, length);
 }
 
 int RecordingBuffer::Read(byte *buffer, size_t length)
 {
-  int dataRead = (int) XBMC->ReadFile(m_inputHandle, buffer, length);
-  if (dataRead==0 && m_isRecording.load())
+  if (m_prefetchServing)
   {
-    XBMC->Log(LOG_DEBUG, "%s:%d: %lld %lld", __FUNCTION__, __LINE__, XBMC->GetFileLength(m_inputHandle) ,XBMC->GetFilePosition(m_inputHandle));
-    if (XBMC->GetFileLength(m_inputHandle) == XBMC->GetFilePosition(m_inputHandle))
+    int dataRead;
+    if (m_prefetchPosition < (int64_t) m_warmData.size())
+    {
+      dataRead = (int) std::min(length, (size_t) (m_warmData.size() - m_prefetchPosition));
+      memcpy(buffer, m_warmData.data() + m_prefetchPosition, dataRead);
+    }
+    else
     {
-      int64_t where = XBMC->GetFileLength(m_inputHandle);
-      Seek(where - length,SEEK_SET);
-      Seek(where,SEEK_SET);
-      if (where != Length())
+      dataRead = m_prefetcher.Read(m_prefetchPosition, buffer, length);
+    }
+    if (dataRead > 0)
+    {
+      m_prefetchPosition += dataRead;
+      if (m_prefetchPosition >= m_prefetchEnd)
+        m_prefetchServing = false;
+      ReportSeekTime(true);
+      CheckEdl();
+      return dataRead;
+    }
+    // the region was dropped before it was used up
+    m_prefetchServing = false;
+    SeekInput(m_prefetchPosition, SEEK_SET);
+  }
+  int dataRead = ReadInput(buffer, length);
+  if (dataRead==0 && m_isRecording.load() && m_growth != nullptr)
+  {
+    int64_t where = Position();
+    XBMC->Log(LOG_DEBUG, "%s:%d: %lld %lld", __FUNCTION__, __LINE__, Length(), where);
+    if (m_growth->WaitForGrowth(where, GROWTH_TIMEOUT))
+    {
+      // native handles pick up the new data by themselves, HTTP needs a new request
+      if (m_growth->IsHttp())
+        ReopenAt(where);
+      else if (m_readAhead != nullptr)
+        m_readAhead->Resume();
+      dataRead = ReadInput(buffer, length);
+    }
+    else if (!m_growth->CanProbe())
+    {
+      // no cheap probe, a single re-open tells whether the recording grew
+      if (ReopenAt(where))
       {
-        XBMC->Log(LOG_INFO, "%s:%d: Before %lld After %lld", __FUNCTION__, __LINE__, where, Length());
+        m_growth->Update(XBMC->GetFileLength(m_inputHandle));
+        if (m_growth->Length() > where)
+        {
+          XBMC->Log(LOG_INFO, "%s:%d: Before %lld After %lld", __FUNCTION__, __LINE__, where, m_growth->Length());
+          dataRead = ReadInput(buffer, length);
+        }
       }
     }
   }
+  if (dataRead > 0)
+  {
+    ReportSeekTime(false);
+    CheckEdl();
+  }
   return dataRead;
 }
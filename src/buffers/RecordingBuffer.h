@@ -21,6 +21,14 @@
 */
 
 #include "Buffer.h"
+#include "ReadAhead.h"
+#include "GrowthTracker.h"
+#include "NativeFile.h"
+#include "RecordingIndex.h"
+#include "Prefetcher.h"
+#include "WarmOpen.h"
+#include <vector>
+#include <chrono>
 
 using namespace ADDON;
 namespace timeshift {
@@ -36,15 +44,13 @@ namespace timeshift {
 
   public:
     RecordingBuffer() : Buffer() { m_Duration = 0; XBMC->Log(LOG_NOTICE, "RecordingBuffer created!"); }
-    virtual ~RecordingBuffer() {}
+    virtual ~RecordingBuffer() { m_warmOpen.Discard(); StopReadAhead(); delete m_growth; delete m_nativeFile; }
+
+    virtual void Close() override;
 
     virtual int Read(byte *buffer, size_t length) override;
 
-    virtual int64_t Seek(int64_t position, int whence) override
-    {
-      XBMC->Log(LOG_DEBUG, "Seek: %s:%d  %lld  %lld %lld", __FUNCTION__, __LINE__,position, XBMC->GetFilePosition(m_inputHandle), XBMC->GetFileLength(m_inputHandle) );
-      return XBMC->SeekFile(m_inputHandle, position, whence);
-    }
+    virtual int64_t Seek(int64_t position, int whence) override;
 
     virtual bool CanPauseStream() const override
     {
@@ -66,10 +72,25 @@ namespace timeshift {
 
     virtual int64_t Length() const override
     {
-      return XBMC->GetFileLength(m_inputHandle);
+      int64_t length;
+      if (m_nativeFile != nullptr)
+        length = m_nativeFile->Length();
+      else if (m_readAhead != nullptr)
+        length = m_readAhead->Length();  // the fill thread shares the handle
+      else
+        length = XBMC->GetFileLength(m_inputHandle);
+      if (m_growth != nullptr && m_growth->Length() > length)
+        return m_growth->Length();
+      return length;
     }
     virtual int64_t Position() const override
     {
+      if (m_prefetchServing)
+        return m_prefetchPosition;
+      if (m_nativeFile != nullptr)
+        return m_nativeFile->Position();
+      if (m_readAhead != nullptr)
+        return m_readAhead->Position();
       return XBMC->GetFilePosition(m_inputHandle);
     }
 
@@ -79,7 +100,128 @@ namespace timeshift {
 
     bool Open(const std::string inputUrl,const PVR_RECORDING &recording);
 
+    /**
+     * @return the native path of hostFilename when it is reachable,
+     * otherwise inputUrl
+     */
+    static std::string ResolvePath(const std::string &inputUrl, const char *hostFilename);
+
+    /**
+     * Resolves and opens the recording expected to play next in the
+     * background, Open() takes it over when it is the one asked for
+     */
+    void PreOpen(const std::string &recordingId, const std::string &inputUrl, const std::string &hostFilename);
+
+    /**
+     * Time index of the open recording, check IsReady() before use
+     */
+    const RecordingIndex &Index() const { return m_index; }
+
+    /**
+     * Commercial breaks of a recording as start/end ms, the end of each
+     * break is prefetched as playback gets close to it
+     */
+    void SetEdl(const std::string &recordingId, const std::vector<std::pair<int, int>> &breaks);
+
     std::atomic<bool> m_isRecording;
     time_t m_recordingTime;
+
+  protected:
+    /**
+     * Whether Read/Seek/Position go through the helpers of this class,
+     * subclasses that drive m_inputHandle themselves turn it off
+     */
+    bool m_managedReads = true;
+
+  private:
+    void StartReadAhead();
+    void StopReadAhead();
+
+    /**
+     * Reads from the read-ahead engine or straight from m_inputHandle
+     */
+    int ReadInput(byte *buffer, size_t length);
+    int64_t SeekInput(int64_t position, int whence);
+
+    /**
+     * @return the average bitrate of the recording, a guess until known
+     */
+    int64_t BytesPerSecond();
+
+    /**
+     * @return the offset of timeMs, -1 when it cannot be worked out
+     */
+    int64_t TimeToOffset(int64_t timeMs);
+
+    /**
+     * Queues the first seconds after timeMs on m_prefetcher
+     */
+    void PrefetchAt(int64_t timeMs);
+
+    /**
+     * Prefetches the end of the next commercial break when it gets close
+     */
+    void CheckEdl();
+
+    /**
+     * Logs how long the last seek took to deliver data
+     */
+    void ReportSeekTime(bool prefetched);
+
+    /**
+     * Opens m_openUrl again at position, so an HTTP handle sees data
+     * written after it was opened
+     */
+    bool ReopenAt(int64_t position);
+
+    /**
+     * The url or native path m_inputHandle was opened with
+     */
+    std::string m_openUrl;
+
+    /**
+     * Direct reader of a recording on a local path, nullptr when reading
+     * through m_inputHandle
+     */
+    NativeFile *m_nativeFile = nullptr;
+
+    RecordingIndex m_index;
+
+    /**
+     * Size tracker of an in-progress recording, nullptr otherwise
+     */
+    GrowthTracker *m_growth = nullptr;
+
+    /**
+     * Background reader of m_inputHandle, nullptr when disabled
+     */
+    ReadAhead *m_readAhead = nullptr;
+
+    std::string m_recordingId;
+    WarmOpen m_warmOpen;
+
+    /**
+     * First bytes of the recording read by its warm open
+     */
+    std::vector<byte> m_warmData;
+
+    Prefetcher m_prefetcher;
+    bool m_prefetching = false;
+
+    /**
+     * Whether reads are served from m_prefetcher, the input is already
+     * positioned at m_prefetchEnd
+     */
+    bool m_prefetchServing = false;
+    int64_t m_prefetchPosition = 0;
+    int64_t m_prefetchEnd = 0;
+
+    std::vector<std::pair<int, int>> m_edl;
+    size_t m_nextBreak = 0;
+
+    std::chrono::steady_clock::time_point m_openTime;
+    std::chrono::steady_clock::time_point m_seekTime;
+    bool m_timingSeek = false;
+    bool m_firstSeek = false;
   };
 }
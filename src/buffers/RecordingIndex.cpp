@@ -0,0 +1,210 @@
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include "RecordingIndex.h"
+#include <chrono>
+#include <vector>
+#include <stdio.h>
+
+using namespace timeshift;
+using namespace ADDON;
+
+#define INDEX_DIRECTORY "special://userdata/addon_data/pvr.nextpvr/index/"
+#define INDEX_MAGIC 0x5849504e  // "NPIX"
+#define INDEX_VERSION 1
+
+// one probe per INDEX_SPACING bytes, capped at INDEX_MAX_POINTS probes
+#define INDEX_SPACING (4 * 1024 * 1024)
+#define INDEX_MAX_POINTS 2048
+#define INDEX_PROBE_SIZE (TS_PACKET_SIZE * 512)
+
+#define PCR_MASK ((((int64_t) 1) << 33) - 1)
+
+void RecordingIndex::Open(const std::string &recordingId, const std::string &url, int64_t length)
+{
+  Close();
+  m_timeline.Reset();
+  m_recordingId = recordingId;
+  m_url = url;
+  m_length = length;
+  m_ready.store(false);
+  m_stop.store(false);
+  if (m_recordingId.empty() || m_length < INDEX_PROBE_SIZE)
+    return;
+
+  if (Load())
+  {
+    m_ready.store(true);
+    return;
+  }
+  m_thread = std::thread([this]()
+  {
+    BuildProc();
+  });
+}
+
+void RecordingIndex::Close()
+{
+  m_stop.store(true);
+  if (m_thread.joinable())
+    m_thread.join();
+  m_ready.store(false);
+}
+
+std::string RecordingIndex::IndexPath() const
+{
+  return INDEX_DIRECTORY + m_recordingId + ".idx";
+}
+
+bool RecordingIndex::Load()
+{
+  char *path = XBMC->TranslateSpecialProtocol(IndexPath().c_str());
+  FILE *file = fopen(path, "rb");
+  XBMC->FreeString(path);
+  if (file == nullptr)
+    return false;
+
+  int32_t header[2];
+  int64_t length;
+  int32_t count;
+  bool ok = fread(header, sizeof(header), 1, file) == 1 && header[0] == INDEX_MAGIC && header[1] == INDEX_VERSION
+    && fread(&length, sizeof(length), 1, file) == 1 && length == m_length
+    && fread(&count, sizeof(count), 1, file) == 1 && count > 0;
+  if (ok)
+  {
+    std::vector<Timeline::sample> samples(count);
+    ok = fread(samples.data(), sizeof(Timeline::sample), count, file) == (size_t) count;
+    for (const Timeline::sample &s : samples)
+    {
+      m_timeline.AddSample(s.offset, s.time);
+    }
+  }
+  fclose(file);
+  if (!ok)
+  {
+    // written for an older size of the recording or damaged
+    m_timeline.Reset();
+    XBMC->Log(LOG_DEBUG, "%s:%d: stale index for %s", __FUNCTION__, __LINE__, m_recordingId.c_str());
+  }
+  return ok;
+}
+
+void RecordingIndex::Save()
+{
+  std::vector<Timeline::sample> samples = m_timeline.Samples();
+  if (samples.empty())
+    return;
+
+  XBMC->CreateDirectory(INDEX_DIRECTORY);
+  char *path = XBMC->TranslateSpecialProtocol(IndexPath().c_str());
+  FILE *file = fopen(path, "wb");
+  XBMC->FreeString(path);
+  if (file == nullptr)
+    return;
+
+  int32_t header[2] = { INDEX_MAGIC, INDEX_VERSION };
+  int32_t count = (int32_t) samples.size();
+  fwrite(header, sizeof(header), 1, file);
+  fwrite(&m_length, sizeof(m_length), 1, file);
+  fwrite(&count, sizeof(count), 1, file);
+  fwrite(samples.data(), sizeof(Timeline::sample), count, file);
+  fclose(file);
+}
+
+void RecordingIndex::BuildProc()
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  void *handle = XBMC->OpenFile(m_url.c_str(), READ_NO_CACHE);
+  if (handle == nullptr)
+  {
+    XBMC->Log(LOG_ERROR, "%s:%d: cannot open %s", __FUNCTION__, __LINE__, m_url.c_str());
+    return;
+  }
+
+  int64_t points = m_length / INDEX_SPACING;
+  if (points < 2)
+    points = 2;
+  else if (points > INDEX_MAX_POINTS)
+    points = INDEX_MAX_POINTS;
+
+  std::vector<byte> buffer(INDEX_PROBE_SIZE);
+  int pid = -1;
+  int64_t lastPcr = -1;
+  int64_t clock = 0;
+  int found = 0;
+  for (int64_t i = 0; i <= points && !m_stop.load(); i++)
+  {
+    int64_t offset = (m_length - INDEX_PROBE_SIZE) * i / points;
+    if (XBMC->SeekFile(handle, offset, SEEK_SET) != offset)
+      continue;
+    int length = 0;
+    while (length < INDEX_PROBE_SIZE)
+    {
+      ssize_t dataRead = XBMC->ReadFile(handle, buffer.data() + length, INDEX_PROBE_SIZE - length);
+      if (dataRead <= 0)
+        break;
+      length += (int) dataRead;
+    }
+
+    // take the first random access point in the probe, else its first PCR
+    int64_t pcr = -1;
+    int at = 0;
+    int scanned = 0;
+    int position;
+    int64_t packetPcr;
+    bool randomAccess;
+    while (FindPcr(buffer.data() + scanned, length - scanned, pid, packetPcr, position, &randomAccess))
+    {
+      if (pcr == -1 || randomAccess)
+      {
+        pcr = packetPcr;
+        at = scanned + position;
+      }
+      if (randomAccess)
+        break;
+      scanned += position + TS_PACKET_SIZE;
+    }
+    if (pcr == -1)
+      continue;
+
+    if (lastPcr != -1)
+    {
+      int64_t delta = (pcr - lastPcr) & PCR_MASK;
+      if (delta > PCR_MASK / 2)
+      {
+        // PCR went backwards, a discontinuity in the recording, skip the probe
+        continue;
+      }
+      clock += delta;
+    }
+    lastPcr = pcr;
+    m_timeline.AddSample(offset + at, clock / 90);
+    found++;
+  }
+  XBMC->CloseFile(handle);
+
+  if (m_stop.load() || found < 2)
+    return;
+
+  m_ready.store(true);
+  Save();
+  XBMC->Log(LOG_INFO, "%s:%d: indexed %s %d points %lld ms in %d ms", __FUNCTION__, __LINE__, m_recordingId.c_str(), found, Duration(),
+    (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
@@ -0,0 +1,86 @@
+#pragma once
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include "Timeline.h"
+
+namespace timeshift {
+
+  /**
+   * Time index of a completed recording. The transport stream is probed
+   * once on a background thread for PCRs, preferring packets flagged as
+   * random access points, and the result is kept as a sidecar file in the
+   * addon's user data keyed by recording id and size.
+   */
+  class RecordingIndex
+  {
+  public:
+    RecordingIndex() : m_stop(false), m_ready(false), m_length(0) {}
+    ~RecordingIndex() { Close(); }
+
+    /**
+     * Loads the sidecar of the recording, or starts building it
+     * @param url where the recording is read from, a native path or http
+     */
+    void Open(const std::string &recordingId, const std::string &url, int64_t length);
+
+    /**
+     * Stops a build in progress, the index is no longer ready
+     */
+    void Close();
+
+    /**
+     * @return whether the index can answer queries
+     */
+    bool IsReady() const { return m_ready.load(); }
+
+    /**
+     * @return the time in ms of offset
+     */
+    int64_t TimeAt(int64_t offset) const { return m_timeline.TimeAt(offset); }
+
+    /**
+     * @return the offset of the random access point at or before timeMs
+     */
+    int64_t OffsetAt(int64_t timeMs) const { return m_timeline.OffsetAt(timeMs); }
+
+    /**
+     * @return the length of the recording in ms
+     */
+    int64_t Duration() const { return m_timeline.TimeAt(m_length); }
+
+  private:
+    void BuildProc();
+    bool Load();
+    void Save();
+    std::string IndexPath() const;
+
+    Timeline m_timeline;
+    std::thread m_thread;
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_ready;
+    std::string m_recordingId;
+    std::string m_url;
+    int64_t m_length;
+  };
+}
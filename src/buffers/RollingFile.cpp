@@ -47,6 +47,13 @@ bool RollingFile::Open(const std::string inputUrl)
   m_activeFilename.clear();
   m_isRecording.store(true);
   slipFiles.clear();
+  m_timeline.Reset();
+  m_timeline.AddSample(0, 0);
+  m_cacheActive = false;
+  if (m_segmentCache != nullptr)
+  {
+    m_segmentCache->Clear();
+  }
   std::stringstream ss;
   m_nextRoll = 0;
 
@@ -98,6 +105,7 @@ bool RollingFile::Open(const std::string inputUrl)
   m_rollingBegin = m_slipStart = time(nullptr);
   XBMC->Log(LOG_DEBUG, "RollingFile::Open in Rolling File Mode: %d", m_isEpgBased);
   m_activeFilename = slipFiles.back().filename;
+  m_activeOffset = slipFiles.back().offset;
   m_activeLength = -1;
   m_tsbThread = std::thread([this]()
   {
@@ -126,7 +134,7 @@ bool RollingFile::RollingFileOpen()
   #if defined(TESTURL)
     strcpy(strURL,TESTURL);
   #else
-    snprintf(strURL,sizeof(strURL),"http://%s:%d/stream?f=%s&sid=%s", g_szHostname.c_str(), g_iPort, UriEncode(m_activeFilename).c_str(), NextPVR::m_backEnd->getSID());
+    snprintf(strURL,sizeof(strURL),"http://%s:%d/stream?f=%s&sid=%s", g_szHostname.c_str(), g_iPort, UriEncode(m_activeFilename).c_str(), NextPVR::m_backEnd->getSID().c_str());
     if (g_NowPlaying == Radio && m_activeLength == -1)
     {
       // reduce buffer for radio when playing in-progess slip file
@@ -206,6 +214,7 @@ bool RollingFile::GetStreamInfo()
             return false;
           }
           m_sd.lastKnownLength.store(length);
+          m_timeline.AddSample(length, duration);
           slipFiles.back().length = length - slipFiles.back().offset;
           m_sd.lastBufferTime = m_nextRoll = LLONG_MAX;
           return true;
@@ -214,7 +223,8 @@ bool RollingFile::GetStreamInfo()
         infoReturn = OK;
         if (duration!=0)
         {
-          m_sd.iBytesPerSecond = length/duration * 1000;
+          m_sd.iBytesPerSecond = (int) (length * 1000 / duration);
+          m_timeline.AddSample(length, duration);
         }
         m_sd.lastKnownLength.store(length);
         TiXmlElement* pFileNode;
@@ -284,7 +294,12 @@ bool RollingFile::GetStreamInfo()
             m_nextRoll = time(nullptr) + g_timeShiftBufferSeconds/3 - 3 + g_ServerTimeOffset;
             if (slipFiles.size() == 5)
             {
+              if (m_segmentCache != nullptr)
+              {
+                m_segmentCache->Evict(slipFiles.front().filename);
+              }
               slipFiles.pop_front();
+              m_timeline.Trim(slipFiles.front().offset);
               m_rollingBegin += g_timeShiftBufferSeconds/3;
             }
           }
@@ -314,8 +329,17 @@ PVR_ERROR RollingFile::GetStreamTimes(PVR_STREAM_TIMES *stimes)
 
   stimes->startTime = m_slipStart;
   stimes->ptsStart = 0;
-  stimes->ptsBegin = (m_rollingBegin - m_slipStart)  * DVD_TIME_BASE;
-  stimes->ptsEnd = (time(nullptr) - m_slipStart) * DVD_TIME_BASE;
+  if (m_timeline.IsEmpty() || Length() == 0)
+  {
+    stimes->ptsBegin = (m_rollingBegin - m_slipStart)  * DVD_TIME_BASE;
+    stimes->ptsEnd = (time(nullptr) - m_slipStart) * DVD_TIME_BASE;
+  }
+  else
+  {
+    // both ends of the buffer from the timeline, O(log n) lookups
+    stimes->ptsBegin = m_timeline.TimeAt(m_timeline.BeginOffset()) * DVD_TIME_BASE / 1000;
+    stimes->ptsEnd = m_timeline.TimeAt(Length()) * DVD_TIME_BASE / 1000;
+  }
   return PVR_ERROR_NO_ERROR;
 }
 
@@ -332,18 +356,24 @@ void RollingFile::Close()
   if (m_tsbThread.joinable())
     m_tsbThread.join();
 
+  m_cacheActive = false;
+  if (m_segmentCache != nullptr)
+  {
+    m_segmentCache->Clear();
+  }
   m_lastClose = time(nullptr);
 }
 int RollingFile::Read(byte *buffer, size_t length)
 {
-  int dataRead = (int) XBMC->ReadFile(m_inputHandle,buffer, length);
+  int dataRead = ReadActiveFile(buffer, length);
   bool foundFile = false;
   if (dataRead == 0)
   {
     RollingFile::GetStreamInfo();
-    if (XBMC->GetFilePosition(m_inputHandle) == m_activeLength)
+    if (FilePosition() == m_activeLength)
     {
       RecordingBuffer::Close();
+      m_cacheActive = false;
       for (std::list<slipFile>::reverse_iterator File=slipFiles.rbegin(); File!=slipFiles.rend(); ++File)
       {
         if (File->filename == m_activeFilename)
@@ -358,6 +388,7 @@ int RollingFile::Read(byte *buffer, size_t length)
           {
             --File;
             m_activeFilename = File->filename;
+            m_activeOffset = File->offset;
             m_activeLength = File->length;
           }
           break;
@@ -367,14 +398,15 @@ int RollingFile::Read(byte *buffer, size_t length)
       {
         // file removed from slip file
         m_activeFilename = slipFiles.front().filename;
+        m_activeOffset = slipFiles.front().offset;
         m_activeLength = slipFiles.front().length;
       }
-      RollingFile::RollingFileOpen();
-      dataRead = (int) XBMC->ReadFile(m_inputHandle, buffer, length);
+      OpenActiveFile(0, SEEK_SET);
+      dataRead = ReadActiveFile(buffer, length);
     }
     else
     {
-      while( XBMC->GetFilePosition(m_inputHandle) == Length())
+      while( FilePosition() == Length())
       {
         RollingFile::GetStreamInfo();
         if (m_nextRoll == LLONG_MAX)
@@ -410,9 +442,10 @@ int64_t RollingFile::Seek(int64_t position, int whence)
     if ( m_activeFilename != slipFiles.back().filename)
     {
       RecordingBuffer::Close();
+      m_cacheActive = false;
       m_activeFilename = slipFiles.back().filename;
+      m_activeOffset = slipFiles.back().offset;
       m_activeLength = slipFiles.back().length;
-      RollingFile::RollingFileOpen();
     }
     adjust = slipFiles.back().offset;
   }
@@ -427,9 +460,10 @@ int64_t RollingFile::Seek(int64_t position, int whence)
         if ( m_activeFilename != prevFile.filename)
         {
           RecordingBuffer::Close();
+          m_cacheActive = false;
           m_activeFilename = prevFile.filename;
+          m_activeOffset = prevFile.offset;
           m_activeLength = prevFile.length;
-          RollingFile::RollingFileOpen();
         }
         break;
       }
@@ -445,5 +479,67 @@ int64_t RollingFile::Seek(int64_t position, int whence)
     adjust = position;
   }
   XBMC->Log(LOG_DEBUG, "%s:%d: %lld %d", __FUNCTION__, __LINE__, position, adjust);
-  return RecordingBuffer::Seek(position - adjust,whence);
+  return OpenActiveFile(position - adjust, whence);
+}
+
+int64_t RollingFile::OpenActiveFile(int64_t offset, int whence)
+{
+  if (m_segmentCache != nullptr && whence == SEEK_SET && m_segmentCache->Contains(m_activeFilename, offset))
+  {
+    // already streamed this part of the slip file, replay it from disk
+    RecordingBuffer::Close();
+    m_cacheActive = true;
+    m_cachePosition = offset;
+    XBMC->Log(LOG_DEBUG, "%s:%d: cached %s %lld", __FUNCTION__, __LINE__, m_activeFilename.c_str(), offset);
+    return offset;
+  }
+  if (m_cacheActive || m_inputHandle == nullptr)
+  {
+    m_cacheActive = false;
+    RollingFile::RollingFileOpen();
+    if (offset == 0 && whence == SEEK_SET)
+    {
+      return 0;
+    }
+  }
+  return RecordingBuffer::Seek(offset, whence);
+}
+
+int RollingFile::ReadActiveFile(byte *buffer, size_t length)
+{
+  if (m_cacheActive)
+  {
+    int dataRead = m_segmentCache->Read(m_activeFilename, m_cachePosition, buffer, length);
+    if (dataRead > 0)
+    {
+      m_cachePosition += dataRead;
+      return dataRead;
+    }
+    if (m_cachePosition == m_activeLength)
+    {
+      // end of a completed slip file, Read() moves on to the next one
+      return 0;
+    }
+    // ran past the cached data, continue from the backend
+    m_cacheActive = false;
+    if (!RollingFile::RollingFileOpen())
+    {
+      return 0;
+    }
+    if (m_cachePosition != 0)
+    {
+      RecordingBuffer::Seek(m_cachePosition, SEEK_SET);
+    }
+  }
+  int64_t where = XBMC->GetFilePosition(m_inputHandle);
+  int dataRead = (int) XBMC->ReadFile(m_inputHandle, buffer, length);
+  if (dataRead > 0)
+  {
+    m_timeline.ScanPackets(m_activeOffset + where, buffer, dataRead);
+    if (m_segmentCache != nullptr)
+    {
+      m_segmentCache->Write(m_activeFilename, where, buffer, dataRead);
+    }
+  }
+  return dataRead;
 }
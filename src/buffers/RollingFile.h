@@ -24,6 +24,8 @@
 #include <mutex>
 #include <list>
 #include "session.h"
+#include "SegmentCache.h"
+#include "Timeline.h"
 
 std::string UriEncode(const std::string sSrc);
 
@@ -41,6 +43,11 @@ namespace timeshift {
     session_data_t m_sd;
     std::string m_activeFilename;
     int64_t m_activeLength;
+
+    /**
+     * Offset of the active slip file in the whole timeshift stream
+     */
+    int64_t m_activeOffset;
     void *m_slipHandle = nullptr;
     time_t m_slipStart;
     time_t m_rollingBegin;
@@ -50,6 +57,24 @@ namespace timeshift {
     int m_liveChunkSize;
     int m_lastClose;
 
+    /**
+     * Local copy of the slip files already streamed, nullptr when disabled
+     */
+    SegmentCache *m_segmentCache;
+
+    /**
+     * Whether reads of the active slip file are served from m_segmentCache,
+     * m_inputHandle is not open while this is set
+     */
+    bool m_cacheActive;
+    int64_t m_cachePosition;
+
+    /**
+     * Byte offset to stream time map of the timeshift stream, seeded from
+     * channel.stream.info and refined with the PCRs of the data read
+     */
+    Timeline m_timeline;
+
     struct slipFile{
       std::string filename;
       int64_t offset;
@@ -67,6 +92,8 @@ namespace timeshift {
   public:
     RollingFile() : RecordingBuffer()
     {
+      // slip files are read and seeked directly on m_inputHandle
+      m_managedReads = false;
       if (!XBMC->GetSetting("prebuffer", &m_prebuffer))
       {
         m_prebuffer = 8;
@@ -76,10 +103,26 @@ namespace timeshift {
         m_liveChunkSize = 64;
       }
       m_lastClose = 0;
+      int cacheSize;
+      if (!XBMC->GetSetting("segmentcache", &cacheSize))
+      {
+        cacheSize = 0;
+      }
+      m_segmentCache = nullptr;
+      if (cacheSize > 0)
+      {
+        m_segmentCache = new SegmentCache((int64_t) cacheSize * 1024 * 1024);
+      }
+      m_cacheActive = false;
+      m_cachePosition = 0;
+      m_activeOffset = 0;
       XBMC->Log(LOG_NOTICE, "EPG Based Buffer created!");
     }
 
-    virtual ~RollingFile() {}
+    virtual ~RollingFile()
+    {
+      delete m_segmentCache;
+    }
 
     virtual bool Open(const std::string inputUrl) override;
     virtual void Close() override;
@@ -103,7 +146,7 @@ namespace timeshift {
 
     virtual int64_t Position() const override
     {
-      return m_activeLength + XBMC->GetFilePosition(m_inputHandle);
+      return m_activeLength + FilePosition();
     }
 
     virtual int Read(byte *buffer, size_t length) override;
@@ -113,6 +156,30 @@ namespace timeshift {
     void TSBTimerProc();
     bool RollingFileOpen();
 
+  private:
+    /**
+     * @return the read position inside the active slip file
+     */
+    int64_t FilePosition() const
+    {
+      if (m_cacheActive)
+        return m_cachePosition;
+      return XBMC->GetFilePosition(m_inputHandle);
+    }
+
+    /**
+     * Positions the active slip file at offset, from the segment cache
+     * when possible, otherwise by opening the file on the backend
+     */
+    int64_t OpenActiveFile(int64_t offset, int whence);
+
+    /**
+     * Reads from the active slip file, tee-ing backend data into the cache
+     */
+    int ReadActiveFile(byte *buffer, size_t length);
+
+  public:
+
     bool GetStreamInfo();
     virtual PVR_ERROR GetStreamTimes(PVR_STREAM_TIMES *) override;
   };
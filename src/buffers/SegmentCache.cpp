@@ -0,0 +1,187 @@
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include "SegmentCache.h"
+#include <algorithm>
+
+#if defined(TARGET_WINDOWS)
+#define FSEEK64 _fseeki64
+#else
+#define FSEEK64 fseeko
+#endif
+
+using namespace timeshift;
+using namespace ADDON;
+
+SegmentCache::SegmentCache(int64_t maxBytes) :
+  m_maxBytes(maxBytes), m_bytesCached(0), m_bytesServed(0), m_nextSegment(0)
+{
+  XBMC->Log(LOG_NOTICE, "SegmentCache created! %lld", maxBytes);
+}
+
+SegmentCache::~SegmentCache()
+{
+  Clear();
+}
+
+SegmentCache::segment *SegmentCache::Find(const std::string &filename)
+{
+  std::map<std::string, segment>::iterator it = m_segments.find(filename);
+  if (it == m_segments.end())
+    return nullptr;
+  return &it->second;
+}
+
+void SegmentCache::Write(const std::string &filename, int64_t offset, const byte *buffer, int length)
+{
+  if (length <= 0)
+    return;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  // make room by dropping the oldest slip files, never the one being written
+  while (m_bytesCached + length > m_maxBytes && !m_order.empty() && m_order.front() != filename)
+  {
+    std::string oldest = m_order.front();
+    EvictLocked(oldest);
+  }
+  if (m_bytesCached + length > m_maxBytes)
+    return;
+
+  segment *seg = Find(filename);
+  if (seg == nullptr)
+  {
+    char name[64];
+    snprintf(name, sizeof(name), "special://userdata/addon_data/pvr.nextpvr/slip%d.cache", m_nextSegment++);
+    char *path = XBMC->TranslateSpecialProtocol(name);
+    segment newSegment;
+    newSegment.path = path;
+    XBMC->FreeString(path);
+    newSegment.handle = fopen(newSegment.path.c_str(), "w+b");
+    newSegment.bytes = 0;
+    if (newSegment.handle == nullptr)
+    {
+      XBMC->Log(LOG_ERROR, "SegmentCache could not create %s", newSegment.path.c_str());
+      return;
+    }
+    m_segments[filename] = newSegment;
+    m_order.push_back(filename);
+    seg = Find(filename);
+  }
+
+  if (FSEEK64(seg->handle, offset, SEEK_SET) != 0 || fwrite(buffer, 1, length, seg->handle) != (size_t) length)
+  {
+    XBMC->Log(LOG_ERROR, "SegmentCache write failed %s %lld", filename.c_str(), offset);
+    return;
+  }
+
+  // merge [offset, offset + length) into the cached extents
+  int64_t start = offset;
+  int64_t end = offset + length;
+  std::map<int64_t, int64_t>::iterator it = seg->extents.upper_bound(start);
+  if (it != seg->extents.begin())
+  {
+    std::map<int64_t, int64_t>::iterator prev = it;
+    --prev;
+    if (prev->second >= start)
+      it = prev;
+  }
+  while (it != seg->extents.end() && it->first <= end)
+  {
+    start = std::min(start, it->first);
+    end = std::max(end, it->second);
+    seg->bytes -= it->second - it->first;
+    m_bytesCached -= it->second - it->first;
+    it = seg->extents.erase(it);
+  }
+  seg->extents[start] = end;
+  seg->bytes += end - start;
+  m_bytesCached += end - start;
+}
+
+int SegmentCache::Read(const std::string &filename, int64_t offset, byte *buffer, size_t length)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  segment *seg = Find(filename);
+  if (seg == nullptr || seg->extents.empty())
+    return 0;
+
+  std::map<int64_t, int64_t>::iterator it = seg->extents.upper_bound(offset);
+  if (it == seg->extents.begin())
+    return 0;
+  --it;
+  if (offset >= it->second)
+    return 0;
+
+  size_t available = (size_t) std::min<int64_t>(length, it->second - offset);
+  fflush(seg->handle);
+  if (FSEEK64(seg->handle, offset, SEEK_SET) != 0)
+    return 0;
+  int dataRead = (int) fread(buffer, 1, available, seg->handle);
+  m_bytesServed += dataRead;
+  return dataRead;
+}
+
+bool SegmentCache::Contains(const std::string &filename, int64_t offset)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  segment *seg = Find(filename);
+  if (seg == nullptr || seg->extents.empty())
+    return false;
+
+  std::map<int64_t, int64_t>::iterator it = seg->extents.upper_bound(offset);
+  if (it == seg->extents.begin())
+    return false;
+  --it;
+  return offset < it->second;
+}
+
+void SegmentCache::Evict(const std::string &filename)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  EvictLocked(filename);
+}
+
+void SegmentCache::EvictLocked(const std::string &filename)
+{
+  segment *seg = Find(filename);
+  if (seg != nullptr)
+  {
+    XBMC->Log(LOG_DEBUG, "SegmentCache evict %s %lld", filename.c_str(), seg->bytes);
+    fclose(seg->handle);
+    remove(seg->path.c_str());
+    m_bytesCached -= seg->bytes;
+    m_segments.erase(filename);
+  }
+  m_order.remove(filename);
+}
+
+void SegmentCache::Clear()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_bytesServed != 0)
+    XBMC->Log(LOG_INFO, "SegmentCache served %lld bytes locally", m_bytesServed);
+  while (!m_order.empty())
+  {
+    std::string oldest = m_order.front();
+    EvictLocked(oldest);
+  }
+  m_bytesCached = 0;
+  m_bytesServed = 0;
+}
@@ -0,0 +1,99 @@
+#pragma once
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include <string>
+#include <map>
+#include <list>
+#include <mutex>
+#include <stdio.h>
+#include "Buffer.h"
+
+namespace timeshift {
+
+  /**
+   * Size capped local copy of the slip files a RollingFile has already
+   * streamed, so seeking back into the buffer can be served from disk
+   * instead of re-opening /stream?f= on the backend.
+   */
+  class SegmentCache
+  {
+  public:
+    SegmentCache(int64_t maxBytes);
+    ~SegmentCache();
+
+    /**
+     * Stores bytes read from the backend for the given slip file
+     */
+    void Write(const std::string &filename, int64_t offset, const byte *buffer, int length);
+
+    /**
+     * Reads cached bytes of a slip file
+     * @return the number of bytes copied, 0 when the offset is not cached
+     */
+    int Read(const std::string &filename, int64_t offset, byte *buffer, size_t length);
+
+    /**
+     * @return whether the byte at offset of the slip file is cached
+     */
+    bool Contains(const std::string &filename, int64_t offset);
+
+    /**
+     * Drops a slip file, called when the backend rolls it off the buffer
+     */
+    void Evict(const std::string &filename);
+
+    /**
+     * Drops every cached slip file
+     */
+    void Clear();
+
+    int64_t BytesCached() const { return m_bytesCached; }
+    int64_t BytesServed() const { return m_bytesServed; }
+
+  private:
+    struct segment
+    {
+      std::string path;
+      FILE *handle;
+      /**
+       * Cached ranges of the slip file, start offset -> end offset
+       */
+      std::map<int64_t, int64_t> extents;
+      int64_t bytes;
+    };
+
+    void EvictLocked(const std::string &filename);
+    segment *Find(const std::string &filename);
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, segment> m_segments;
+
+    /**
+     * Slip files in the order they were first cached, oldest first
+     */
+    std::list<std::string> m_order;
+
+    int64_t m_maxBytes;
+    int64_t m_bytesCached;
+    int64_t m_bytesServed;
+    int m_nextSegment;
+  };
+}
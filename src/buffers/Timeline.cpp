@@ -0,0 +1,266 @@
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include "Timeline.h"
+#include <algorithm>
+
+using namespace timeshift;
+
+#define PCR_MASK ((((int64_t) 1) << 33) - 1)
+#define PCR_PER_MS 90
+// PCR jumps larger than this are treated as a discontinuity
+#define PCR_MAX_GAP (PCR_PER_MS * 10000)
+// take at most one PCR sample per second of stream
+#define PCR_SAMPLE_INTERVAL (PCR_PER_MS * 1000)
+// PCR derived times further than this from the backend's get re-anchored
+#define PCR_MAX_DRIFT 5000
+
+bool timeshift::FindPcr(const byte *buffer, int length, int &pid, int64_t &pcr, int &position, bool *randomAccess)
+{
+  int i = 0;
+  while (i + TS_PACKET_SIZE <= length)
+  {
+    // resync on a packet boundary
+    if (buffer[i] != 0x47 || (i + TS_PACKET_SIZE < length && buffer[i + TS_PACKET_SIZE] != 0x47))
+    {
+      i++;
+      continue;
+    }
+    const byte *packet = buffer + i;
+    int packetPid = ((packet[1] & 0x1f) << 8) | packet[2];
+    bool hasAdaptation = (packet[3] & 0x20) != 0;
+    if (hasAdaptation && packet[4] >= 7 && (packet[5] & 0x10) && (pid == -1 || pid == packetPid))
+    {
+      pcr = ((int64_t) packet[6] << 25) | ((int64_t) packet[7] << 17) | ((int64_t) packet[8] << 9) | ((int64_t) packet[9] << 1) | ((int64_t) packet[10] >> 7);
+      pid = packetPid;
+      position = i;
+      if (randomAccess != nullptr)
+      {
+        *randomAccess = (packet[5] & 0x40) != 0;
+      }
+      return true;
+    }
+    i += TS_PACKET_SIZE;
+  }
+  return false;
+}
+
+void Timeline::Reset()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_samples.clear();
+  m_pcrPid = -1;
+  m_lastPcr = -1;
+  m_pcrClock = 0;
+  m_pcrAnchorClock = -1;
+  m_pcrAnchorTime = 0;
+  m_lastPcrSample = 0;
+}
+
+void Timeline::AddSample(int64_t offset, int64_t timeMs)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  Insert(offset, timeMs);
+}
+
+void Timeline::Insert(int64_t offset, int64_t timeMs)
+{
+  std::vector<sample>::iterator it = std::lower_bound(m_samples.begin(), m_samples.end(), offset,
+    [](const sample &s, int64_t value) { return s.offset < value; });
+  if (it != m_samples.end() && it->offset == offset)
+  {
+    it->time = timeMs;
+  }
+  else
+  {
+    sample newSample;
+    newSample.offset = offset;
+    newSample.time = timeMs;
+    it = m_samples.insert(it, newSample);
+  }
+
+  // keep the timeline monotonic, the newest sample wins
+  size_t index = it - m_samples.begin();
+  while (index > 0 && m_samples[index - 1].time > timeMs)
+  {
+    m_samples.erase(m_samples.begin() + index - 1);
+    index--;
+  }
+  while (index + 1 < m_samples.size() && m_samples[index + 1].time < timeMs)
+  {
+    m_samples.erase(m_samples.begin() + index + 1);
+  }
+}
+
+void Timeline::ScanPackets(int64_t offset, const byte *buffer, int length)
+{
+  int pid;
+  int position;
+  int64_t pcr;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    pid = m_pcrPid;
+  }
+  if (!FindPcr(buffer, length, pid, pcr, position))
+    return;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_samples.empty())
+    return;
+
+  m_pcrPid = pid;
+  int64_t at = offset + position;
+  if (m_lastPcr >= 0)
+  {
+    int64_t delta = (pcr - m_lastPcr) & PCR_MASK;
+    if (delta > PCR_MAX_GAP)
+    {
+      // seek or stream discontinuity
+      m_pcrAnchorClock = -1;
+    }
+    else
+    {
+      m_pcrClock += delta;
+    }
+  }
+  m_lastPcr = pcr;
+
+  if (m_pcrAnchorClock < 0)
+  {
+    m_pcrAnchorClock = m_lastPcrSample = m_pcrClock;
+    m_pcrAnchorTime = TimeAtLocked(at);
+    return;
+  }
+  if (m_pcrClock - m_lastPcrSample < PCR_SAMPLE_INTERVAL)
+    return;
+
+  m_lastPcrSample = m_pcrClock;
+  int64_t pcrTime = m_pcrAnchorTime + (m_pcrClock - m_pcrAnchorClock) / PCR_PER_MS;
+  int64_t estimate = TimeAtLocked(at);
+  if (pcrTime - estimate > PCR_MAX_DRIFT || estimate - pcrTime > PCR_MAX_DRIFT)
+  {
+    m_pcrAnchorClock = m_pcrClock;
+    m_pcrAnchorTime = estimate;
+    return;
+  }
+  Insert(at, pcrTime);
+}
+
+void Timeline::Trim(int64_t offset)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_samples.empty() || offset <= m_samples.front().offset)
+    return;
+
+  sample begin;
+  begin.offset = offset;
+  begin.time = TimeAtLocked(offset);
+  std::vector<sample>::iterator it = std::upper_bound(m_samples.begin(), m_samples.end(), offset,
+    [](int64_t value, const sample &s) { return value < s.offset; });
+  m_samples.erase(m_samples.begin(), it);
+  if (m_samples.empty() || m_samples.front().offset != offset)
+  {
+    m_samples.insert(m_samples.begin(), begin);
+  }
+}
+
+int64_t Timeline::TimeAt(int64_t offset) const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return TimeAtLocked(offset);
+}
+
+int64_t Timeline::TimeAtLocked(int64_t offset) const
+{
+  if (m_samples.empty())
+    return 0;
+
+  std::vector<sample>::const_iterator it = std::upper_bound(m_samples.begin(), m_samples.end(), offset,
+    [](int64_t value, const sample &s) { return value < s.offset; });
+  if (it == m_samples.begin())
+    return m_samples.front().time;
+
+  const sample &low = *(it - 1);
+  const sample *high = nullptr;
+  if (it != m_samples.end())
+  {
+    high = &*it;
+  }
+  else if (m_samples.size() > 1)
+  {
+    // past the last sample, extrapolate at the average rate
+    const sample &first = m_samples.front();
+    if (low.offset == first.offset)
+      return low.time;
+    return low.time + (int64_t) ((double) (offset - low.offset) * (low.time - first.time) / (low.offset - first.offset));
+  }
+  if (high == nullptr || high->offset == low.offset)
+    return low.time;
+  return low.time + (int64_t) ((double) (offset - low.offset) * (high->time - low.time) / (high->offset - low.offset));
+}
+
+int64_t Timeline::OffsetAt(int64_t timeMs) const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_samples.empty())
+    return 0;
+
+  std::vector<sample>::const_iterator it = std::upper_bound(m_samples.begin(), m_samples.end(), timeMs,
+    [](int64_t value, const sample &s) { return value < s.time; });
+  if (it == m_samples.begin())
+    return m_samples.front().offset;
+
+  const sample &low = *(it - 1);
+  const sample *high = nullptr;
+  if (it != m_samples.end())
+  {
+    high = &*it;
+  }
+  else if (m_samples.size() > 1)
+  {
+    const sample &first = m_samples.front();
+    if (low.time == first.time)
+      return low.offset;
+    return low.offset + (int64_t) ((double) (timeMs - low.time) * (low.offset - first.offset) / (low.time - first.time));
+  }
+  if (high == nullptr || high->time == low.time)
+    return low.offset;
+  return low.offset + (int64_t) ((double) (timeMs - low.time) * (high->offset - low.offset) / (high->time - low.time));
+}
+
+int64_t Timeline::BeginOffset() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_samples.empty())
+    return 0;
+  return m_samples.front().offset;
+}
+
+bool Timeline::IsEmpty() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_samples.empty();
+}
+
+std::vector<Timeline::sample> Timeline::Samples() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_samples;
+}
@@ -0,0 +1,113 @@
+#pragma once
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include <vector>
+#include <mutex>
+#include "Buffer.h"
+
+namespace timeshift {
+
+  const int TS_PACKET_SIZE = 188;
+
+  /**
+   * Finds the first transport stream packet carrying a PCR
+   * @param pid the PCR pid to look for, -1 accepts any pid and returns the one found
+   * @param pcr the PCR base (90kHz) of the packet
+   * @param position the offset of the packet in buffer
+   * @param randomAccess optional, whether the packet has the random access indicator set
+   * @return whether a PCR was found
+   */
+  bool FindPcr(const byte *buffer, int length, int &pid, int64_t &pcr, int &position, bool *randomAccess = nullptr);
+
+  /**
+   * Maps byte offsets of a stream to stream time (and back) from a sorted
+   * list of samples. Coarse samples come from the backend (Length/Duration
+   * of channel.stream.info) and are refined by PCR samples taken from the
+   * data as it is read.
+   */
+  class Timeline
+  {
+  public:
+    struct sample
+    {
+      int64_t offset;
+      int64_t time;
+    };
+
+    Timeline() { Reset(); }
+
+    void Reset();
+
+    /**
+     * Records that the byte at offset is played at timeMs
+     */
+    void AddSample(int64_t offset, int64_t timeMs);
+
+    /**
+     * Looks for a PCR in data read from offset and records it
+     */
+    void ScanPackets(int64_t offset, const byte *buffer, int length);
+
+    /**
+     * Drops samples before offset, keeping an interpolated sample at offset
+     */
+    void Trim(int64_t offset);
+
+    /**
+     * @return the stream time in ms of offset
+     */
+    int64_t TimeAt(int64_t offset) const;
+
+    /**
+     * @return the byte offset played at timeMs
+     */
+    int64_t OffsetAt(int64_t timeMs) const;
+
+    /**
+     * @return the first offset still on the timeline
+     */
+    int64_t BeginOffset() const;
+
+    bool IsEmpty() const;
+
+    /**
+     * @return a copy of the samples, sorted by offset
+     */
+    std::vector<sample> Samples() const;
+
+  private:
+    void Insert(int64_t offset, int64_t timeMs);
+    int64_t TimeAtLocked(int64_t offset) const;
+
+    mutable std::mutex m_mutex;
+    std::vector<sample> m_samples;
+
+    /**
+     * PCR tracking, times are extended past the 33 bit wrap
+     */
+    int m_pcrPid;
+    int64_t m_lastPcr;
+    int64_t m_pcrClock;
+    int64_t m_pcrAnchorClock;
+    int64_t m_pcrAnchorTime;
+    int64_t m_lastPcrSample;
+  };
+}
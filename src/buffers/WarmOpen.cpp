@@ -0,0 +1,104 @@
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include "WarmOpen.h"
+#include "RecordingBuffer.h"
+#include <chrono>
+#include <sstream>
+
+using namespace timeshift;
+using namespace ADDON;
+
+void WarmOpen::Start(const std::string &recordingId, const std::string &inputUrl, const std::string &hostFilename, int prefetchBytes)
+{
+  Discard();
+  m_recordingId = recordingId;
+  m_inputUrl = inputUrl;
+  m_hostFilename = hostFilename;
+  m_prefetchBytes = prefetchBytes;
+  XBMC->Log(LOG_DEBUG, "%s:%d: %s", __FUNCTION__, __LINE__, recordingId.c_str());
+  m_thread = std::thread([this]()
+  {
+    OpenProc();
+  });
+}
+
+void WarmOpen::OpenProc()
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  m_openUrl = RecordingBuffer::ResolvePath(m_inputUrl, m_hostFilename.c_str());
+  std::stringstream ss;
+  ss << m_openUrl;
+  if (m_openUrl.rfind("http", 0) == 0)
+  {
+    // same timeout Buffer::Open uses
+    ss << "|connection-timeout=" << 10;
+  }
+  m_handle = XBMC->OpenFile(ss.str().c_str(), 0);
+  if (m_handle == nullptr)
+  {
+    XBMC->Log(LOG_ERROR, "%s:%d: cannot open %s", __FUNCTION__, __LINE__, m_openUrl.c_str());
+    return;
+  }
+  m_data.resize(m_prefetchBytes);
+  int filled = 0;
+  while (filled < m_prefetchBytes)
+  {
+    ssize_t dataRead = XBMC->ReadFile(m_handle, m_data.data() + filled, m_prefetchBytes - filled);
+    if (dataRead <= 0)
+      break;
+    filled += (int) dataRead;
+  }
+  m_data.resize(filled);
+  XBMC->Log(LOG_DEBUG, "%s:%d: %s ready in %d ms", __FUNCTION__, __LINE__, m_recordingId.c_str(),
+    (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+bool WarmOpen::Take(const std::string &recordingId, std::string &openUrl, void *&handle, std::vector<byte> &data)
+{
+  if (m_thread.joinable())
+    m_thread.join();
+  if (m_handle == nullptr || recordingId != m_recordingId)
+  {
+    Discard();
+    return false;
+  }
+  openUrl = m_openUrl;
+  handle = m_handle;
+  data.swap(m_data);
+  m_handle = nullptr;
+  m_data.clear();
+  m_recordingId.clear();
+  return true;
+}
+
+void WarmOpen::Discard()
+{
+  if (m_thread.joinable())
+    m_thread.join();
+  if (m_handle != nullptr)
+  {
+    XBMC->Log(LOG_DEBUG, "%s:%d: unused %s", __FUNCTION__, __LINE__, m_recordingId.c_str());
+    XBMC->CloseFile(m_handle);
+    m_handle = nullptr;
+  }
+  m_data.clear();
+  m_recordingId.clear();
+}
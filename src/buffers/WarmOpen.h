@@ -0,0 +1,66 @@
+#pragma once
+/*
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with XBMC; see the file COPYING.  If not, write to
+*  the Free Software Foundation, 51 Franklin Street, Fifth Floor, Boston,
+*  MA 02110-1301  USA
+*  http://www.gnu.org/copyleft/gpl.html
+*
+*/
+
+#include <string>
+#include <vector>
+#include <thread>
+#include "Buffer.h"
+
+namespace timeshift {
+
+  /**
+   * Opens a recording ahead of time on a background thread: resolves its
+   * path, opens the handle and reads its first bytes. The handle is handed
+   * over when that recording is opened next, and closed otherwise.
+   */
+  class WarmOpen
+  {
+  public:
+    WarmOpen() : m_handle(nullptr), m_prefetchBytes(0) {}
+    ~WarmOpen() { Discard(); }
+
+    void Start(const std::string &recordingId, const std::string &inputUrl, const std::string &hostFilename, int prefetchBytes);
+
+    /**
+     * Hands over the warm handle when it is for recordingId, waiting for
+     * an open still in progress. Any other warm handle is closed.
+     * @return whether openUrl, handle and data were filled in
+     */
+    bool Take(const std::string &recordingId, std::string &openUrl, void *&handle, std::vector<byte> &data);
+
+    /**
+     * Closes the warm handle, if any
+     */
+    void Discard();
+
+  private:
+    void OpenProc();
+
+    std::thread m_thread;
+    std::string m_recordingId;
+    std::string m_inputUrl;
+    std::string m_hostFilename;
+    std::string m_openUrl;
+    void *m_handle;
+    std::vector<byte> m_data;
+    int m_prefetchBytes;
+  };
+}
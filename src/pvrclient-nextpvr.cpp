@@ -20,8 +20,14 @@
 #include <ctime>
 #include <stdio.h>
 #include <stdlib.h>
-#include <regex>
+#include <string.h>
+#include <ctype.h>
 #include <memory>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <limits>
+#include <functional>
 
 #include <p8-platform/util/StringUtils.h>
 
@@ -61,6 +67,17 @@ int g_ServerTimeOffset = 0;
 #define HTTP_NOTFOUND 404
 #define HTTP_BADREQUEST 400
 
+// percentage of a recording played before the next episode is opened
+#define PREOPEN_PERCENT 95
+
+// listings requests waiting on the backend's workers while loading the guide
+#define GUIDE_MAX_PENDING 64
+
+// recordings converted per task, and chunks converted ahead of the one transferred
+#define RECORDING_CHUNK 128
+#define RECORDING_CHUNKS_AHEAD 8
+#define PARSE_MAX_WORKERS 4
+
 #define DEBUGGING_XML 0
 #if DEBUGGING_XML
 void dump_to_log( TiXmlNode* pParent, unsigned int indent);
@@ -143,7 +160,6 @@ cPVRClientNextPVR::cPVRClientNextPVR()
   m_streamingclient        = new NextPVR::Socket(NextPVR::af_inet, NextPVR::pf_inet, NextPVR::sock_stream, NextPVR::tcp);
   m_bConnected             = false;
   NextPVR::m_backEnd       = new NextPVR::Request();
-  m_iChannelCount          = 0;
   m_currentRecordingLength = 0;
 
   m_supportsLiveTimeshift  = false;
@@ -159,12 +175,31 @@ cPVRClientNextPVR::cPVRClientNextPVR()
   m_realTimeBuffer = new timeshift::DummyBuffer();
   m_livePlayer = nullptr;
 
+  bool guideCache;
+  if (XBMC->GetSetting("guidecache", &guideCache) && guideCache)
+  {
+    m_epgStore.Open("special://userdata/addon_data/pvr.nextpvr/guide-" + g_szHostname + ".epg");
+  }
+  // the index takes memory and time on every guide load, so it is off unless asked for
+  m_bGuideIndex = false;
+  XBMC->GetSetting("guideindex", &m_bGuideIndex);
+  m_iconSync.Open("special://userdata/addon_data/pvr.nextpvr/icons-" + g_szHostname + ".txt");
+  int artworkCache;
+  if (XBMC->GetSetting("artworkcache", &artworkCache) && artworkCache > 0)
+  {
+    m_artworkCache.Open("special://userdata/addon_data/pvr.nextpvr/artwork-" + g_szHostname + "/", (int64_t) artworkCache * 1024 * 1024);
+  }
+  // recording lists are converted on the calling thread with a single core
+  unsigned int cores = std::thread::hardware_concurrency();
+  m_parseWorkers.Start(cores > 1 ? std::min(cores, (unsigned int) PARSE_MAX_WORKERS) : 0);
+
   CreateThread();
 }
 
 cPVRClientNextPVR::~cPVRClientNextPVR()
 {
-  StopThread();
+  // 0 waits without a timeout, the thread still uses the members torn down below
+  StopThread(0);
 
   XBMC->Log(LOG_DEBUG, "->~cPVRClientNextPVR()");
   if (m_bConnected)
@@ -201,6 +236,7 @@ std::vector<std::string> cPVRClientNextPVR::split(const std::string& s, const st
 bool cPVRClientNextPVR::Connect()
 {
   string result;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
   m_bConnected = false;
   // initiate session
   std::string response;
@@ -249,9 +285,11 @@ bool cPVRClientNextPVR::Connect()
         {
           if (strstr(loginResponse.c_str(), "<rsp stat=\"ok\">"))
           {
-            // check server version
+            // check server version, the settings come in while the live streams load
             std::string settings;
-            if (DoRequest("/service?method=setting.list", settings) == HTTP_OK)
+            std::future<int> settingsResult = NextPVR::m_backEnd->DoRequestAsync("/service?method=setting.list", settings);
+            LoadLiveStreams();
+            if (settingsResult.get() == HTTP_OK)
             {
               // if it's a NextPVR server, check the verions. WinTV Extend servers work a slightly different way.
               TiXmlDocument settingsDoc;
@@ -356,8 +394,8 @@ bool cPVRClientNextPVR::Connect()
             }
 
             m_bConnected = true;
-            LoadLiveStreams();
-            XBMC->Log(LOG_DEBUG, "session.login successful");
+            XBMC->Log(LOG_DEBUG, "session.login successful in %d ms",
+              (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
             return true;
           }
         }
@@ -409,6 +447,9 @@ bool cPVRClientNextPVR::IsUp()
           int64_t update_time = atoll(last_update->GetText());
           if (update_time > m_lastRecordingUpdateTime)
           {
+            // the backend changed, cached responses may be out of date
+            NextPVR::m_backEnd->InvalidateCache("");
+            m_catalog.Invalidate();
             m_lastRecordingUpdateTime = MAXINT64;
             PVR->TriggerRecordingUpdate();
             PVR->TriggerTimerUpdate();
@@ -435,9 +476,26 @@ bool cPVRClientNextPVR::IsUp()
 void *cPVRClientNextPVR::Process(void)
 {
   LOG_API_CALL(__FUNCTION__);
+  // listings of the guide cache, shards fetched later are indexed as they come in
+  if (m_bGuideIndex)
+  {
+    m_epgStore.VisitShards([this](int channelId, time_t shardStart, const std::vector<NextPVR::epgEntry> &entries)
+    {
+      if (!IsStopped())
+        m_guideIndex.Add(channelId, shardStart, entries);
+    });
+    m_guideIndex.LogStats();
+  }
+  std::function<bool()> stopping = [this]() { return IsStopped(); };
   while (!IsStopped())
   {
     IsUp();
+    RefreshGuide();
+    // Kodi lists the channels again to pick up the icons fetched
+    if (m_bConnected && !IsStopped() && m_iconSync.Sync(stopping))
+      PVR->TriggerChannelUpdate();
+    if (m_bConnected && !IsStopped())
+      m_artworkCache.Prefetch(stopping);
     Sleep(2500);
   }
   return NULL;
@@ -548,206 +606,354 @@ PVR_ERROR cPVRClientNextPVR::GetDriveSpace(long long *iTotal, long long *iUsed)
 /************************************************************/
 /** EPG handling */
 
-PVR_ERROR cPVRClientNextPVR::GetEpg(ADDON_HANDLE handle, const PVR_CHANNEL &channel, time_t iStart, time_t iEnd)
-{
-  EPG_TAG broadcast;
+/* fields of a channel.listings entry, empty when not sent */
+struct listingFields
+{
+  NextPVR::XmlView id;
+  NextPVR::XmlView name;
+  NextPVR::XmlView description;
+  NextPVR::XmlView subtitle;
+  NextPVR::XmlView year;
+  NextPVR::XmlView start;
+  NextPVR::XmlView end;
+  NextPVR::XmlView genre;
+  NextPVR::XmlView genreType;
+  NextPVR::XmlView genreSubtype;
+  NextPVR::XmlView season;
+  NextPVR::XmlView episode;
+};
 
-  std::string response;
-  char request[512];
-  LOG_API_CALL(__FUNCTION__);
-  if ( iEnd < (time(nullptr) - 24 * 3600))
-  {
-      XBMC->Log(LOG_DEBUG, "Skipping expired EPG data %d %ld %lld",channel.iUniqueId,iStart, iEnd);
-      return PVR_ERROR_INVALID_PARAMETERS;
+/* reads the fields of the listing at the reader's start tag in one pass */
+static void ReadListingFields(NextPVR::XmlReader &reader, listingFields &fields)
+{
+  int depth = reader.Depth();
+  while (reader.NextChild(depth))
+  {
+    const NextPVR::XmlView &name = reader.Name();
+    if (name.Equals("id"))
+      fields.id = reader.ReadText();
+    else if (name.Equals("name"))
+      fields.name = reader.ReadText();
+    else if (name.Equals("description"))
+      fields.description = reader.ReadText();
+    else if (name.Equals("subtitle"))
+      fields.subtitle = reader.ReadText();
+    else if (name.Equals("year"))
+      fields.year = reader.ReadText();
+    else if (name.Equals("start"))
+      fields.start = reader.ReadText();
+    else if (name.Equals("end"))
+      fields.end = reader.ReadText();
+    else if (name.Equals("genre"))
+      fields.genre = reader.ReadText();
+    else if (name.Equals("genre_type"))
+      fields.genreType = reader.ReadText();
+    else if (name.Equals("genre_subtype"))
+      fields.genreSubtype = reader.ReadText();
+    else if (name.Equals("season"))
+      fields.season = reader.ReadText();
+    else if (name.Equals("episode"))
+      fields.episode = reader.ReadText();
+    else
+      reader.Skip();
   }
-  sprintf(request, "/service?method=channel.listings&channel_id=%d&start=%d&end=%d", channel.iUniqueId, (int)iStart, (int)iEnd);
-  if (DoRequest(request, response) == HTTP_OK)
-  {
-    TiXmlDocument doc;
-    if (doc.Parse(response.c_str()) != NULL)
-    {
-      TiXmlElement* listingsNode = doc.RootElement()->FirstChildElement("listings");
-      TiXmlElement* pListingNode;
-      for( pListingNode = listingsNode->FirstChildElement("l"); pListingNode; pListingNode=pListingNode->NextSiblingElement())
-      {
-        memset(&broadcast, 0, sizeof(EPG_TAG));
+}
 
-        string title;
-        string description;
-        string subtitle;
-        title = pListingNode->FirstChildElement("name")->FirstChild()->Value();
-        if (pListingNode->FirstChildElement("description") != NULL && pListingNode->FirstChildElement("description")->FirstChild() != NULL)
-        {
-          description = pListingNode->FirstChildElement("description")->FirstChild()->Value();
-        }
-        else
-        {
-          description = "";
-        }
+/* times are sent in ticks, the first 10 digits are the epoch seconds */
+static time_t ToEpochSeconds(NextPVR::XmlView ticks)
+{
+  if (ticks.length > 10)
+    ticks.length = 10;
+  return (time_t) ticks.ToInt64();
+}
 
-        if (pListingNode->FirstChildElement("subtitle") != NULL && pListingNode->FirstChildElement("subtitle")->FirstChild() != NULL)
-        {
-          subtitle = pListingNode->FirstChildElement("subtitle")->FirstChild()->Value();
-          if (description == subtitle + ":")
-          {
-            description = "";
-          }
-          else if (StringUtils::StartsWith(description,subtitle + ": "))
-          {
-            description = description.substr(subtitle.length()+2);
-          }
-        }
-        else
-        {
-          subtitle = "";
-        }
+/* reads the listings of a channel.listings response */
+static void ParseListings(const std::string &response, NextPVR::EpgListings &listings)
+{
+  NextPVR::XmlReader reader(response);
+  if (!reader.Find("listings"))
+    return;
+  // reused for every listing, EpgListings keeps its own copy of the text
+  std::string title;
+  std::string subtitle;
+  std::string description;
+  std::string genre;
+  char year[16];
+  int listingsDepth = reader.Depth();
+  while (reader.NextChild(listingsDepth))
+  {
+    listingFields fields;
+    ReadListingFields(reader, fields);
 
-        if (pListingNode->FirstChildElement("year") != NULL && pListingNode->FirstChildElement("year")->FirstChild() != NULL)
-        {
-          broadcast.iYear = atoi(pListingNode->FirstChildElement("year")->FirstChild()->Value());
-          title += " (" + std::to_string(broadcast.iYear) + ")";
-        }
-        else
-        {
-          broadcast.iYear = 0;
-        }
+    fields.name.TextTo(title);
+    fields.description.TextTo(description);
+    fields.subtitle.TextTo(subtitle);
+    size_t length = subtitle.length();
+    if (length > 0 && description.length() > length && description[length] == ':' && description.compare(0, length, subtitle) == 0)
+    {
+      // drop "subtitle:" or "subtitle: " at the start of the description
+      if (description.length() == length + 1)
+      {
+        description.clear();
+      }
+      else if (description[length + 1] == ' ')
+      {
+        description.erase(0, length + 2);
+      }
+    }
 
-        char start[32];
-        strncpy(start, pListingNode->FirstChildElement("start")->FirstChild()->Value(), sizeof start);
-        start[10] = '\0';
-
-        char end[32];
-        strncpy(end, pListingNode->FirstChildElement("end")->FirstChild()->Value(), sizeof end);
-        end[10] = '\0';
-
-        broadcast.iUniqueBroadcastId  = atoi(pListingNode->FirstChildElement("id")->FirstChild()->Value());
-        broadcast.strTitle            = title.c_str();
-        broadcast.strEpisodeName      = subtitle.c_str();
-        broadcast.iUniqueChannelId    = channel.iUniqueId;
-        broadcast.startTime           = atol(start);
-        broadcast.endTime             = atol(end);
-        broadcast.strPlotOutline      = NULL; //unused
-        broadcast.strPlot             = description.c_str();
-        broadcast.strOriginalTitle    = NULL; // unused
-        broadcast.strCast             = NULL; // unused
-        broadcast.strDirector         = NULL; // unused
-        broadcast.strWriter           = NULL; // unused
-        broadcast.strIMDBNumber       = NULL; // unused
-
-        // artwork URL
-        char artworkPath[128];
-        artworkPath[0] = '\0';
-        if (g_bDownloadGuideArtwork)
-        {
-          snprintf(artworkPath, sizeof(artworkPath), "http://%s:%d/service?method=channel.show.artwork&sid=%s&event_id=%d", g_szHostname.c_str(), g_iPort, m_sid, broadcast.iUniqueBroadcastId);
-          broadcast.strIconPath         = artworkPath;
-        }
+    NextPVR::epgEntry entry;
+    entry.year = fields.year.ToInt();
+    if (!fields.year.Empty())
+    {
+      snprintf(year, sizeof(year), " (%d)", entry.year);
+      title += year;
+    }
+    fields.genre.TextTo(genre);
 
-        char genre[128];
-        genre[0] = '\0';
-        if (pListingNode->FirstChildElement("genre") != NULL && pListingNode->FirstChildElement("genre")->FirstChild() != NULL)
-        {
-          broadcast.iGenreType = EPG_GENRE_USE_STRING;
-          PVR_STRCPY(genre, pListingNode->FirstChildElement("genre")->FirstChild()->Value());
-          broadcast.strGenreDescription = genre;
-        }
-        else
-        {
-          // genre type
-          if (pListingNode->FirstChildElement("genre_type") != NULL && pListingNode->FirstChildElement("genre_type")->FirstChild() != NULL)
-          {
-            broadcast.iGenreType = atoi(pListingNode->FirstChildElement("genre_type")->FirstChild()->Value());
-          }
+    entry.id = fields.id.ToInt();
+    entry.start = ToEpochSeconds(fields.start);
+    entry.end = ToEpochSeconds(fields.end);
+    entry.title = title.c_str();
+    entry.subtitle = subtitle.c_str();
+    entry.description = description.c_str();
+    entry.genre = genre.c_str();
+    entry.genreType = fields.genreType.ToInt();
+    entry.genreSubtype = fields.genreSubtype.ToInt();
+    entry.season = fields.season.ToInt();
+    entry.episode = fields.episode.ToInt();
+    listings.Add(entry);
+  }
+}
 
-          // genre subtype
-          if (pListingNode->FirstChildElement("genre_subtype") != NULL && pListingNode->FirstChildElement("genre_subtype")->FirstChild() != NULL)
-          {
-            broadcast.iGenreSubType = atoi(pListingNode->FirstChildElement("genre_subtype")->FirstChild()->Value());
-          }
-        }
+void cPVRClientNextPVR::LoadShards(const std::vector<int> &channelIds, const std::vector<time_t> &shards, std::vector<int> &loadedChannelIds)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-        if (pListingNode->FirstChildElement("season") != NULL && pListingNode->FirstChildElement("season")->FirstChild() != NULL)
-        {
-          broadcast.iSeriesNumber = atoi(pListingNode->FirstChildElement("season")->FirstChild()->Value());
-        }
-        else
+  // the requests run on the backend's workers, which also parse the
+  // responses, and are started shard by shard in the order given
+  std::mutex mutex;
+  std::condition_variable finished;
+  int pending = 0;
+  int requests = 0;
+  int listingCount = 0;
+  for (time_t shardStart : shards)
+  {
+    for (int channelId : channelIds)
+    {
+      // a few requests queued at a time, so that unloading is not held up
+      // by the rest of the guide
+      if (IsStopped())
+        break;
+      if (!m_epgStore.NeedsFetch(channelId, shardStart))
+        continue;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&pending]() { return pending < GUIDE_MAX_PENDING; });
+        pending++;
+      }
+      requests++;
+      char request[512];
+      sprintf(request, "/service?method=channel.listings&channel_id=%d&start=%d&end=%d", channelId, (int)shardStart, (int)(shardStart + EPG_SHARD_SECONDS));
+      NextPVR::m_backEnd->DoRequestAsync(request, [&, channelId, shardStart](int resultCode, const std::string &response)
+      {
+        NextPVR::EpgListings listings;
+        if (resultCode == HTTP_OK)
         {
-          broadcast.iSeriesNumber = 0;
-
+          ParseListings(response, listings);
         }
-        if (pListingNode->FirstChildElement("episode") != NULL && pListingNode->FirstChildElement("episode")->FirstChild() != NULL)
+        int count = (int) listings.Entries().size();
+        if (resultCode == HTTP_OK)
         {
-          broadcast.iEpisodeNumber = atoi(pListingNode->FirstChildElement("episode")->FirstChild()->Value());
+          if (m_bGuideIndex)
+            m_guideIndex.Put(channelId, shardStart, listings.Entries());
+          m_epgStore.Put(channelId, shardStart, listings);
         }
-        else
+        std::unique_lock<std::mutex> lock(mutex);
+        if (resultCode == HTTP_OK)
         {
-          broadcast.iEpisodeNumber = 0;
+          if (std::find(loadedChannelIds.begin(), loadedChannelIds.end(), channelId) == loadedChannelIds.end())
+            loadedChannelIds.push_back(channelId);
+          listingCount += count;
         }
-
-        broadcast.firstAired         = 0;  // unused
-        broadcast.iParentalRating    = 0;  // unused
-        broadcast.iStarRating        = 0;  // unused
-        broadcast.bNotify            = false;
-        broadcast.iEpisodePartNumber = 0;  // unused
-
-        PVR->TransferEpgEntry(handle, &broadcast);
-      }
+        pending--;
+        finished.notify_one();
+      });
     }
   }
-
-  return PVR_ERROR_NO_ERROR;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&pending]() { return pending == 0; });
+  }
+  XBMC->Log(LOG_DEBUG, "%s:%d: %d shards of %d channels, %d listings, loaded in %d ms with %d requests", __FUNCTION__, __LINE__, (int) shards.size(), (int) channelIds.size(), listingCount,
+    (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(), requests);
+  m_epgStore.LogStats();
+  if (m_bGuideIndex)
+    m_guideIndex.LogStats();
 }
 
+void cPVRClientNextPVR::RefreshGuide()
+{
+  time_t iStart;
+  time_t iEnd;
+  std::chrono::steady_clock::time_point loadStart;
+  if (!m_bConnected || !m_epgStore.TakeRefresh(iStart, iEnd, loadStart))
+    return;
+  std::vector<int> channelIds = m_epgStore.GetChannels();
+  if (channelIds.empty())
+    return;
 
-/************************************************************/
-/** Channel handling */
+  // the shards closest to now first, they are looked at first
+  time_t now = time(nullptr);
+  std::vector<time_t> shards;
+  for (time_t shardStart = NextPVR::EpgStore::ShardStart(iStart); shardStart < iEnd; shardStart += EPG_SHARD_SECONDS)
+  {
+    shards.push_back(shardStart);
+  }
+  time_t nowShard = NextPVR::EpgStore::ShardStart(now);
+  std::stable_sort(shards.begin(), shards.end(), [nowShard](time_t a, time_t b)
+  {
+    return std::abs((long long) (a - nowShard)) < std::abs((long long) (b - nowShard));
+  });
 
-int cPVRClientNextPVR::GetNumChannels(void)
+  std::vector<int> loadedChannelIds;
+  LoadShards(channelIds, shards, loadedChannelIds);
+  if (IsStopped())
+    return;
+  m_epgStore.Save();
+  if (loadStart.time_since_epoch().count() != 0)
+  {
+    XBMC->Log(LOG_DEBUG, "%s:%d: guide complete in %d ms", __FUNCTION__, __LINE__,
+      (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - loadStart).count());
+  }
+  // Kodi asks again for the channels that changed
+  for (int channelId : loadedChannelIds)
+  {
+    PVR->TriggerEpgUpdate(channelId);
+  }
+}
+
+PVR_ERROR cPVRClientNextPVR::GetEpg(ADDON_HANDLE handle, const PVR_CHANNEL &channel, time_t iStart, time_t iEnd)
 {
   LOG_API_CALL(__FUNCTION__);
-  if (m_iChannelCount != -1)
-    return m_iChannelCount;
+  if ( iEnd < (time(nullptr) - 24 * 3600))
+  {
+      XBMC->Log(LOG_DEBUG, "Skipping expired EPG data %d %ld %lld",channel.iUniqueId,iStart, iEnd);
+      return PVR_ERROR_INVALID_PARAMETERS;
+  }
 
+  // the text of entry is only valid during the call
+  auto transfer = [this, handle, &channel](const NextPVR::epgEntry &entry)
+  {
+    EPG_TAG broadcast;
+    memset(&broadcast, 0, sizeof(EPG_TAG));
+
+    broadcast.iYear               = entry.year;
+    broadcast.iUniqueBroadcastId  = entry.id;
+    broadcast.strTitle            = entry.title;
+    broadcast.strEpisodeName      = entry.subtitle;
+    broadcast.iUniqueChannelId    = channel.iUniqueId;
+    broadcast.startTime           = entry.start;
+    broadcast.endTime             = entry.end;
+    broadcast.strPlotOutline      = NULL; //unused
+    broadcast.strPlot             = entry.description;
+    broadcast.strOriginalTitle    = NULL; // unused
+    broadcast.strCast             = NULL; // unused
+    broadcast.strDirector         = NULL; // unused
+    broadcast.strWriter           = NULL; // unused
+    broadcast.strIMDBNumber       = NULL; // unused
+
+    // artwork URL, or its local copy
+    std::string artworkPath;
+    if (g_bDownloadGuideArtwork)
+    {
+      char resource[128];
+      char artworkUrl[256];
+      snprintf(resource, sizeof(resource), "/service?method=channel.show.artwork&event_id=%d", broadcast.iUniqueBroadcastId);
+      snprintf(artworkUrl, sizeof(artworkUrl), "http://%s:%d/service?method=channel.show.artwork&sid=%s&event_id=%d", g_szHostname.c_str(), g_iPort, m_sid, broadcast.iUniqueBroadcastId);
+      artworkPath = m_artworkCache.GetPath("event-" + std::to_string(broadcast.iUniqueBroadcastId), resource, artworkUrl);
+      if (!artworkPath.empty())
+        broadcast.strIconPath       = artworkPath.c_str();
+    }
 
-  // need something more optimal, but this will do for now...
-  std::string response;
-  if (DoRequest("/service?method=channel.list", response) == HTTP_OK)
-  {
-    TiXmlDocument doc;
-    if (doc.Parse(response.c_str()) != NULL)
+    if (*entry.genre != '\0')
     {
-      m_iChannelCount = 0;
-      TiXmlElement* channelsNode = doc.RootElement()->FirstChildElement("channels");
-      TiXmlElement* pChannelNode;
-      for( pChannelNode = channelsNode->FirstChildElement("channel"); pChannelNode; pChannelNode=pChannelNode->NextSiblingElement())
-      {
-        m_iChannelCount++;
-      }
+      broadcast.iGenreType = EPG_GENRE_USE_STRING;
+      broadcast.strGenreDescription = entry.genre;
+    }
+    else
+    {
+      broadcast.iGenreType = entry.genreType;
+      broadcast.iGenreSubType = entry.genreSubtype;
     }
-  }
 
-  return m_iChannelCount;
-}
+    broadcast.iSeriesNumber      = entry.season;
+    broadcast.iEpisodeNumber     = entry.episode;
+    broadcast.firstAired         = 0;  // unused
+    broadcast.iParentalRating    = 0;  // unused
+    broadcast.iStarRating        = 0;  // unused
+    broadcast.bNotify            = false;
+    broadcast.iEpisodePartNumber = 0;  // unused
 
-std::string cPVRClientNextPVR::GetChannelIcon(int channelID)
-{
-  LOG_API_CALL(__FUNCTION__);
+    PVR->TransferEpgEntry(handle, &broadcast);
+  };
 
-  std::string iconFilename = GetChannelIconFileName(channelID);
+  bool current = false;
+  if (m_epgStore.Get(channel.iUniqueId, iStart, iEnd, transfer, current))
+  {
+    if (!current)
+    {
+      // answered from the listings held, brought up to date in the background
+      m_epgStore.RequestRefresh(iStart, iEnd);
+    }
+    return PVR_ERROR_NO_ERROR;
+  }
 
-  // do we already have the icon file?
-  if (XBMC->FileExists(iconFilename.c_str(), false))
+  // the shards showing now and next
+  time_t now = time(nullptr);
+  std::vector<time_t> nowShards;
+  for (time_t shardStart = NextPVR::EpgStore::ShardStart(std::max(now, iStart)); shardStart < now + 3 * 3600 && shardStart < iEnd; shardStart += EPG_SHARD_SECONDS)
   {
-    return iconFilename;
+    nowShards.push_back(shardStart);
   }
-  char strURL[256];
-  sprintf(strURL, "/service?method=channel.icon&channel_id=%d", channelID);
-  if (NextPVR::m_backEnd->FileCopy(strURL, iconFilename) == HTTP_OK)
+  if (!m_epgStore.IsGuideLoaded(iStart, iEnd))
   {
-    return iconFilename;
+    // only now and next of all channels is waited for, the rest of the
+    // window follows on the background thread
+    std::vector<int> channelIds = m_epgStore.GetChannels();
+    if (!channelIds.empty())
+    {
+      std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+      std::vector<int> loadedChannelIds;
+      LoadShards(channelIds, nowShards, loadedChannelIds);
+      XBMC->Log(LOG_DEBUG, "%s:%d: guide usable in %d ms", __FUNCTION__, __LINE__,
+        (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - loadStart).count());
+      m_epgStore.SetGuideLoaded(iStart, iEnd);
+      m_epgStore.RequestRefresh(iStart, iEnd, loadStart);
+      m_epgStore.Save();
+    }
+  }
+  if (!m_epgStore.Get(channel.iUniqueId, iStart, iEnd, transfer, current))
+  {
+    // not a channel of the guide load, or its requests failed
+    std::vector<int> loadedChannelIds;
+    LoadShards(std::vector<int>(1, channel.iUniqueId), nowShards, loadedChannelIds);
+    if (m_epgStore.Get(channel.iUniqueId, iStart, iEnd, transfer, current) && !current)
+      m_epgStore.RequestRefresh(iStart, iEnd);
   }
 
-  return "";
+  return PVR_ERROR_NO_ERROR;
+}
+
+
+/************************************************************/
+/** Channel handling */
+
+int cPVRClientNextPVR::GetNumChannels(void)
+{
+  LOG_API_CALL(__FUNCTION__);
+  m_catalog.Update();
+  return m_catalog.ChannelCount();
 }
 
 std::string cPVRClientNextPVR::GetChannelIconFileName(int channelID)
@@ -763,7 +969,7 @@ void cPVRClientNextPVR::LoadLiveStreams()
 {
   char strURL[256];
   sprintf(strURL, "/public/LiveStreams.xml");
-  m_liveStreams.clear();
+  std::map<int, std::string> streams;
   if (NextPVR::m_backEnd->FileCopy(strURL, "special://userdata/addon_data/pvr.nextpvr/LiveStreams.xml") == HTTP_OK)
   {
     TiXmlDocument doc;
@@ -785,7 +991,7 @@ void cPVRClientNextPVR::LoadLiveStreams()
               {
                 int channelID = std::stoi(key_value);
                 XBMC->Log(LOG_DEBUG, "%d %s",channelID, streamNode->FirstChild()->Value());
-                m_liveStreams[channelID] = streamNode->FirstChild()->Value();
+                streams[channelID] = streamNode->FirstChild()->Value();
               }
             } catch (...)
             {
@@ -796,76 +1002,50 @@ void cPVRClientNextPVR::LoadLiveStreams()
       }
     }
   }
+  m_catalog.SetLiveStreams(streams);
 }
 
 PVR_ERROR cPVRClientNextPVR::GetChannels(ADDON_HANDLE handle, bool bRadio)
 {
-  PVR_CHANNEL     tag;
-  std::string      stream;
   LOG_API_CALL(__FUNCTION__);
 
-  m_channelTypes.clear();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
   int channelCount = 0;
-  std::string response;
-  if (DoRequest("/service?method=channel.list", response) == HTTP_OK)
+  if (m_catalog.Update())
   {
-    TiXmlDocument doc;
-    if (doc.Parse(response.c_str()) != NULL)
+    // TV and radio channels, the guide is loaded for both at once
+    m_epgStore.SetChannels(m_catalog.GetChannelIds());
+  }
+  m_catalog.VisitChannels(bRadio, [this, handle, &channelCount](const NextPVR::catalogChannel &channel, const char *name)
+  {
+    PVR_CHANNEL tag;
+    memset(&tag, 0, sizeof(PVR_CHANNEL));
+    tag.iUniqueId = channel.id;
+    tag.bIsRadio = channel.isRadio;
+    if (channel.isRadio)
     {
-      //XBMC->Log(LOG_NOTICE, "Channels:\n");
-      //dump_to_log(&doc, 0);
-      channelCount = 0;
-      TiXmlElement* channelsNode = doc.RootElement()->FirstChildElement("channels");
-      TiXmlElement* pChannelNode;
-      for( pChannelNode = channelsNode->FirstChildElement("channel"); pChannelNode; pChannelNode=pChannelNode->NextSiblingElement())
-      {
-        memset(&tag, 0, sizeof(PVR_CHANNEL));
-        TiXmlElement* channelTypeNode = pChannelNode->FirstChildElement("type");
-        tag.iUniqueId = atoi(pChannelNode->FirstChildElement("id")->FirstChild()->Value());
-        if (strcmp(channelTypeNode->FirstChild()->Value(), "0xa") == 0)
-        {
-          tag.bIsRadio = true;
-          PVR_STRCPY(tag.strInputFormat, "application/octet-stream");
-        }
-        else
-        {
-          tag.bIsRadio = false;
-          if (!IsChannelAPlugin(tag.iUniqueId))
-            PVR_STRCPY(tag.strInputFormat, "video/mp2t");
-        }
-        if (bRadio != tag.bIsRadio)
-          continue;
-
-        tag.iChannelNumber = atoi(pChannelNode->FirstChildElement("number")->FirstChild()->Value());
-
-        // handle major.minor style subchannels
-        if (pChannelNode->FirstChildElement("minor"))
-        {
-          tag.iSubChannelNumber = atoi(pChannelNode->FirstChildElement("minor")->FirstChild()->Value());
-        }
-
-        PVR_STRCPY(tag.strChannelName, pChannelNode->FirstChildElement("name")->FirstChild()->Value());
+      PVR_STRCPY(tag.strInputFormat, "application/octet-stream");
+    }
+    else if (!channel.isPlugin)
+    {
+      PVR_STRCPY(tag.strInputFormat, "video/mp2t");
+    }
+    tag.iChannelNumber = channel.number;
+    // handle major.minor style subchannels
+    tag.iSubChannelNumber = channel.minor;
+    PVR_STRCPY(tag.strChannelName, name);
 
-        // check if we need to download a channel icon
-        if (pChannelNode->FirstChildElement("icon"))
-        {
-          std::string iconFile = GetChannelIcon(tag.iUniqueId);
-          if (iconFile.length() > 0)
-          {
-            PVR_STRCPY(tag.strIconPath, iconFile.c_str());
-          }
-        }
-        if ( !m_channelTypes[tag.iUniqueId])
-        {
-          m_channelTypes[tag.iUniqueId] = tag.bIsRadio;
-        }
-        // transfer channel to XBMC
-        PVR->TransferChannelEntry(handle, &tag);
-        channelCount++;
-      }
+    // icons not held yet are fetched in the background
+    if (channel.hasIcon)
+    {
+      PVR_STRCPY(tag.strIconPath, m_iconSync.GetIcon(tag.iUniqueId, GetChannelIconFileName(tag.iUniqueId)).c_str());
     }
-    m_iChannelCount = channelCount;
-  }
+    // transfer channel to XBMC
+    PVR->TransferChannelEntry(handle, &tag);
+    channelCount++;
+  });
+  XBMC->Log(LOG_DEBUG, "%s:%d: %d channels in %d ms", __FUNCTION__, __LINE__, channelCount,
+    (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
   return PVR_ERROR_NO_ERROR;
 }
 
@@ -875,32 +1055,12 @@ PVR_ERROR cPVRClientNextPVR::GetChannels(ADDON_HANDLE handle, bool bRadio)
 int cPVRClientNextPVR::GetChannelGroupsAmount(void)
 {
   LOG_API_CALL(__FUNCTION__);
-  // Not directly possible at the moment
-  XBMC->Log(LOG_DEBUG, "GetChannelGroupsAmount");
-
-  int groups = 0;
-
-  std::string response;
-  if (DoRequest("/service?method=channel.groups", response) == HTTP_OK)
-  {
-    TiXmlDocument doc;
-    if (doc.Parse(response.c_str()) != NULL)
-    {
-      TiXmlElement* groupsNode = doc.RootElement()->FirstChildElement("groups");
-      TiXmlElement* pGroupNode;
-      for( pGroupNode = groupsNode->FirstChildElement("group"); pGroupNode; pGroupNode=pGroupNode->NextSiblingElement())
-      {
-        groups++;
-      }
-    }
-  }
-
-  return groups;
+  m_catalog.Update();
+  return m_catalog.GroupCount();
 }
 
 PVR_ERROR cPVRClientNextPVR::GetChannelGroups(ADDON_HANDLE handle, bool bRadio)
 {
-  PVR_CHANNEL_GROUP tag;
   LOG_API_CALL(__FUNCTION__);
 
   // nextpvr doesn't have a separate concept of radio channel groups
@@ -908,29 +1068,21 @@ PVR_ERROR cPVRClientNextPVR::GetChannelGroups(ADDON_HANDLE handle, bool bRadio)
     return PVR_ERROR_NO_ERROR;
 
   // for tv, use the groups returned by nextpvr
-  std::string response;
-  if (DoRequest("/service?method=channel.groups", response) == HTTP_OK)
+  m_catalog.Update();
+  m_catalog.VisitGroups([handle](const char *name)
   {
-    TiXmlDocument doc;
-    if (doc.Parse(response.c_str()) != NULL)
-    {
-      TiXmlElement* groupsNode = doc.RootElement()->FirstChildElement("groups");
-      TiXmlElement* pGroupNode;
-      for( pGroupNode = groupsNode->FirstChildElement("group"); pGroupNode; pGroupNode=pGroupNode->NextSiblingElement())
-      {
-        memset(&tag, 0, sizeof(PVR_CHANNEL_GROUP));
-        tag.bIsRadio  = false;
-        tag.iPosition = 0; // groups default order, unused
-        strncpy(tag.strGroupName, pGroupNode->FirstChildElement("name")->FirstChild()->Value(), sizeof tag.strGroupName);
+    PVR_CHANNEL_GROUP tag;
+    memset(&tag, 0, sizeof(PVR_CHANNEL_GROUP));
+    tag.bIsRadio  = false;
+    tag.iPosition = 0; // groups default order, unused
+    strncpy(tag.strGroupName, name, sizeof tag.strGroupName - 1);
 
-        // tell XBMC about channel, ignoring "All Channels" since xbmc has an built in group with effectively the same function
-        if (strcmp(tag.strGroupName, "All Channels") != 0)
-        {
-          PVR->TransferChannelGroup(handle, &tag);
-        }
-      }
+    // tell XBMC about channel, ignoring "All Channels" since xbmc has an built in group with effectively the same function
+    if (strcmp(tag.strGroupName, "All Channels") != 0)
+    {
+      PVR->TransferChannelGroup(handle, &tag);
     }
-  }
+  });
   return PVR_ERROR_NO_ERROR;
 }
 
@@ -939,7 +1091,7 @@ PVR_ERROR cPVRClientNextPVR::GetChannelStreamProperties(const PVR_CHANNEL &chann
   if (IsChannelAPlugin(channel.iUniqueId)!= 0)
   {
     strncpy(properties[0].strName, PVR_STREAM_PROPERTY_STREAMURL, sizeof(properties[0].strName) - 1);
-    strncpy(properties[0].strValue,m_liveStreams[channel.iUniqueId].c_str(), sizeof(properties[0].strValue) - 1);
+    strncpy(properties[0].strValue, m_catalog.GetLiveStream(channel.iUniqueId).c_str(), sizeof(properties[0].strValue) - 1);
     *iPropertiesCount = 1;
     return PVR_ERROR_NO_ERROR;
   }
@@ -949,43 +1101,25 @@ PVR_ERROR cPVRClientNextPVR::GetChannelStreamProperties(const PVR_CHANNEL &chann
 
 bool cPVRClientNextPVR::IsChannelAPlugin(int uid)
 {
-  if (m_liveStreams.count(uid)!= 0)
-    if (StringUtils::StartsWith(m_liveStreams[uid],"plugin:"))
-      return true;
-
-  return false;
+  return m_catalog.IsPlugin(uid);
 }
 
 
 PVR_ERROR cPVRClientNextPVR::GetChannelGroupMembers(ADDON_HANDLE handle, const PVR_CHANNEL_GROUP &group)
 {
-  std::string encodedGroupName = UriEncode(group.strGroupName);
   LOG_API_CALL(__FUNCTION__);
 
-  char request[512];
-  sprintf(request, "/service?method=channel.list&group_id=%s", encodedGroupName.c_str());
-
-  std::string response;
-  if (DoRequest(request, response) == HTTP_OK)
+  m_catalog.Update();
+  m_catalog.VisitMembers(group.strGroupName, [handle, &group](int channelId, int number)
   {
     PVR_CHANNEL_GROUP_MEMBER tag;
+    memset(&tag, 0, sizeof(PVR_CHANNEL_GROUP_MEMBER));
+    strncpy(tag.strGroupName, group.strGroupName, sizeof(tag.strGroupName) - 1);
+    tag.iChannelUniqueId = channelId;
+    tag.iChannelNumber = number;
 
-    TiXmlDocument doc;
-    if (doc.Parse(response.c_str()) != NULL)
-    {
-      TiXmlElement* channelsNode = doc.RootElement()->FirstChildElement("channels");
-      TiXmlElement* pChannelNode;
-      for( pChannelNode = channelsNode->FirstChildElement("channel"); pChannelNode; pChannelNode=pChannelNode->NextSiblingElement())
-      {
-        memset(&tag, 0, sizeof(PVR_CHANNEL_GROUP_MEMBER));
-        strncpy(tag.strGroupName, group.strGroupName, sizeof(tag.strGroupName));
-        tag.iChannelUniqueId = atoi(pChannelNode->FirstChildElement("id")->FirstChild()->Value());
-        tag.iChannelNumber = atoi(pChannelNode->FirstChildElement("number")->FirstChild()->Value());
-
-        PVR->TransferChannelGroupMember(handle, &tag);
-      }
-    }
-  }
+    PVR->TransferChannelGroupMember(handle, &tag);
+  });
 
   return PVR_ERROR_NO_ERROR;
 }
@@ -993,6 +1127,90 @@ PVR_ERROR cPVRClientNextPVR::GetChannelGroupMembers(ADDON_HANDLE handle, const P
 /************************************************************/
 /** Record handling **/
 
+/* reads the fields of the recording at the reader's start tag in one pass */
+static void ReadRecordingFields(NextPVR::XmlReader &reader, recordingFields &fields)
+{
+  int depth = reader.Depth();
+  while (reader.NextChild(depth))
+  {
+    const NextPVR::XmlView &name = reader.Name();
+    if (name.Equals("id"))
+      fields.id = reader.ReadText();
+    else if (name.Equals("name"))
+      fields.name = reader.ReadText();
+    else if (name.Equals("subtitle"))
+      fields.subtitle = reader.ReadText();
+    else if (name.Equals("desc"))
+      fields.desc = reader.ReadText();
+    else if (name.Equals("reason"))
+      fields.reason = reader.ReadText();
+    else if (name.Equals("status"))
+      fields.status = reader.ReadText();
+    else if (name.Equals("start_time_ticks"))
+      fields.startTimeTicks = reader.ReadText();
+    else if (name.Equals("duration_seconds"))
+      fields.durationSeconds = reader.ReadText();
+    else if (name.Equals("epg_event_oid"))
+      fields.epgEventOid = reader.ReadText();
+    else if (name.Equals("playback_position"))
+      fields.playbackPosition = reader.ReadText();
+    else if (name.Equals("channel_id"))
+      fields.channelId = reader.ReadText();
+    else if (name.Equals("file"))
+      fields.file = reader.ReadText();
+    else
+      reader.Skip();
+  }
+}
+
+/**
+ * Splits a recording.list response after every RECORDING_CHUNK recordings.
+ * The first chunk also holds the document head and the last one its tail.
+ */
+static void SplitRecordings(const std::string &response, std::vector<recordingChunk> &chunks)
+{
+  static const char endTag[] = "</recording>";
+  recordingChunk chunk;
+  chunk.done = false;
+  size_t begin = 0;
+  size_t pos = 0;
+  int count = 0;
+  while ((pos = response.find(endTag, pos)) != std::string::npos)
+  {
+    pos += sizeof(endTag) - 1;
+    if (++count == RECORDING_CHUNK)
+    {
+      chunk.data = response.data() + begin;
+      chunk.length = pos - begin;
+      chunks.push_back(chunk);
+      begin = pos;
+      count = 0;
+    }
+  }
+  chunk.data = response.data() + begin;
+  chunk.length = response.size() - begin;
+  chunks.push_back(chunk);
+}
+
+void cPVRClientNextPVR::ParseRecordingChunk(recordingChunk &chunk)
+{
+  NextPVR::XmlReader reader(chunk.data, chunk.length);
+  PVR_RECORDING tag;
+  chunk.tags.reserve(RECORDING_CHUNK);
+  while (reader.Find("recording"))
+  {
+    recordingFields fields;
+    ReadRecordingFields(reader, fields);
+    memset(&tag, 0, sizeof(PVR_RECORDING));
+    if (UpdatePvrRecording(fields, &tag))
+    {
+      chunk.tags.push_back(tag);
+      chunk.hostFilenames.push_back(fields.file.Text());
+      chunk.ready.push_back(fields.status.Text() == "Ready");
+    }
+  }
+}
+
 int cPVRClientNextPVR::GetNumRecordings(void)
 {
   // need something more optimal, but this will do for now...
@@ -1005,18 +1223,15 @@ int cPVRClientNextPVR::GetNumRecordings(void)
   std::string response;
   if (DoRequest("/service?method=recording.list&filter=ready", response) == HTTP_OK)
   {
-    TiXmlDocument doc;
-    if (doc.Parse(response.c_str()) != NULL)
+    NextPVR::XmlReader reader(response);
+    if (reader.Find("recordings"))
     {
-      TiXmlElement* recordingsNode = doc.RootElement()->FirstChildElement("recordings");
-      if (recordingsNode != NULL)
+      int recordingsDepth = reader.Depth();
+      m_iRecordingCount = 0;
+      while (reader.NextChild(recordingsDepth))
       {
-        TiXmlElement* pRecordingNode;
-        m_iRecordingCount = 0;
-        for( pRecordingNode = recordingsNode->FirstChildElement("recording"); pRecordingNode; pRecordingNode=pRecordingNode->NextSiblingElement())
-        {
-          m_iRecordingCount++;
-        }
+        m_iRecordingCount++;
+        reader.Skip();
       }
     }
   }
@@ -1028,30 +1243,65 @@ PVR_ERROR cPVRClientNextPVR::GetRecordings(ADDON_HANDLE handle)
 {
   // include already-completed recordings
   PVR_ERROR returnValue = PVR_ERROR_NO_ERROR;
-  m_hostFilenames.clear();
   LOG_API_CALL(__FUNCTION__);
   int recordingCount = 0;
   std::string response;
   if (DoRequest("/service?method=recording.list&filter=all", response) == HTTP_OK)
   {
-    TiXmlDocument doc;
-    if (doc.Parse(response.c_str()) != NULL)
+    std::chrono::steady_clock::time_point parseStart = std::chrono::steady_clock::now();
+    std::map<std::string, std::string> hostFilenames;
+    std::map<std::string, std::vector<seriesEpisode>> seriesEpisodes;
+    std::vector<recordingChunk> chunks;
+    SplitRecordings(response, chunks);
+    std::mutex chunkMutex;
+    std::condition_variable chunkParsed;
+    size_t submitted = 0;
+    for (size_t i = 0; i < chunks.size(); i++)
     {
-      dump_to_log(&doc, 0);
-      PVR_RECORDING   tag;
-      TiXmlElement* recordingsNode = doc.RootElement()->FirstChildElement("recordings");
-      TiXmlElement* pRecordingNode;
-      for( pRecordingNode = recordingsNode->FirstChildElement("recording"); pRecordingNode; pRecordingNode=pRecordingNode->NextSiblingElement())
+      // only a few chunks convert ahead, each holds RECORDING_CHUNK full tags
+      for (; submitted < chunks.size() && submitted < i + RECORDING_CHUNKS_AHEAD; submitted++)
+      {
+        recordingChunk *pending = &chunks[submitted];
+        m_parseWorkers.Submit([this, pending, &chunkMutex, &chunkParsed]()
+        {
+          ParseRecordingChunk(*pending);
+          std::unique_lock<std::mutex> lock(chunkMutex);
+          pending->done = true;
+          chunkParsed.notify_all();
+        });
+      }
+      recordingChunk &chunk = chunks[i];
+      {
+        std::unique_lock<std::mutex> lock(chunkMutex);
+        chunkParsed.wait(lock, [&chunk]() { return chunk.done; });
+      }
+      for (size_t j = 0; j < chunk.tags.size(); j++)
       {
-        memset(&tag, 0, sizeof(PVR_RECORDING));
-        if (UpdatePvrRecording(pRecordingNode, &tag))
+        PVR_RECORDING &tag = chunk.tags[j];
+        hostFilenames[tag.strRecordingId] = chunk.hostFilenames[j];
+        if (chunk.ready[j])
         {
-          recordingCount++;
-          PVR->TransferRecordingEntry(handle, &tag);
+          seriesEpisode entry;
+          entry.recordingId = tag.strRecordingId;
+          entry.season = tag.iSeriesNumber;
+          entry.episode = tag.iEpisodeNumber;
+          entry.recordingTime = tag.recordingTime;
+          seriesEpisodes[tag.strDirectory].push_back(entry);
         }
+        PVR->TransferRecordingEntry(handle, &tag);
       }
+      recordingCount += (int) chunk.tags.size();
+      std::vector<PVR_RECORDING>().swap(chunk.tags);
+    }
+    {
+      // both are looked up on the playback thread
+      std::unique_lock<std::mutex> lock(m_recordingsMutex);
+      m_hostFilenames.swap(hostFilenames);
+      m_seriesEpisodes.swap(seriesEpisodes);
     }
     m_iRecordingCount = recordingCount;
+    XBMC->Log(LOG_DEBUG, "%s:%d: %d recordings in %d chunks parsed in %d ms", __FUNCTION__, __LINE__, recordingCount, (int) chunks.size(),
+      (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - parseStart).count());
     XBMC->Log(LOG_DEBUG, "Updated recordings %lld", m_lastRecordingUpdateTime);
   }
   else
@@ -1063,34 +1313,29 @@ PVR_ERROR cPVRClientNextPVR::GetRecordings(ADDON_HANDLE handle)
   return returnValue;
 }
 
-bool cPVRClientNextPVR::UpdatePvrRecording(TiXmlElement* pRecordingNode, PVR_RECORDING *tag)
+bool cPVRClientNextPVR::UpdatePvrRecording(const recordingFields &fields, PVR_RECORDING *tag)
 {
 
-  tag->recordingTime = atol(pRecordingNode->FirstChildElement("start_time_ticks")->FirstChild()->Value());
+  tag->recordingTime = (time_t) fields.startTimeTicks.ToInt64();
 
-  std::string status = pRecordingNode->FirstChildElement("status")->FirstChild()->Value();
+  std::string status = fields.status.Text();
   if (status=="Pending"  && tag->recordingTime > time(nullptr) + g_ServerTimeOffset)
   {
     // skip timers
     return false;
   }
-  tag->iDuration = atoi(pRecordingNode->FirstChildElement("duration_seconds")->FirstChild()->Value());
+  tag->iDuration = fields.durationSeconds.ToInt();
 
+  std::string name = fields.name.Text();
   if (status == "Ready" || status == "Pending" || status == "Recording")
   {
-    snprintf(tag->strDirectory,sizeof(tag->strDirectory),"/%s",pRecordingNode->FirstChildElement("name")->FirstChild()->Value());
-    if (pRecordingNode->FirstChildElement("desc") != NULL && pRecordingNode->FirstChildElement("desc")->FirstChild() != NULL)
-    {
-      PVR_STRCPY(tag->strPlot, pRecordingNode->FirstChildElement("desc")->FirstChild()->Value());
-    }
+    snprintf(tag->strDirectory,sizeof(tag->strDirectory),"/%s",name.c_str());
+    fields.desc.CopyTo(tag->strPlot, sizeof(tag->strPlot));
   }
   else if (status == "Failed")
   {
-    snprintf(tag->strDirectory,sizeof(tag->strDirectory),"/%s/%s",XBMC->GetLocalizedString(30166),pRecordingNode->FirstChildElement("name")->FirstChild()->Value());
-    if (pRecordingNode->FirstChildElement("reason") != NULL && pRecordingNode->FirstChildElement("reason")->FirstChild() != NULL)
-    {
-      PVR_STRCPY(tag->strPlot, pRecordingNode->FirstChildElement("reason")->FirstChild()->Value());
-    }
+    snprintf(tag->strDirectory,sizeof(tag->strDirectory),"/%s/%s",XBMC->GetLocalizedString(30166),name.c_str());
+    fields.reason.CopyTo(tag->strPlot, sizeof(tag->strPlot));
     if (tag->iDuration < 0)
     {
       tag->iDuration = 0;
@@ -1106,45 +1351,31 @@ bool cPVRClientNextPVR::UpdatePvrRecording(TiXmlElement* pRecordingNode, PVR_REC
      XBMC->Log(LOG_ERROR, "Unknown status %s",status.c_str());
      return false;
   }
-  if (status == "Recording")
+  if (status == "Recording" && !fields.epgEventOid.Empty())
   {
-    if (pRecordingNode->FirstChildElement("epg_event_oid"))
-    {
-      // EPG Event ID is not valid on most older recordings
-      if (atoi(pRecordingNode->FirstChildElement("recurring_parent")->FirstChild()->Value()) != 0 && pRecordingNode->FirstChildElement("epg_event_oid") != NULL && pRecordingNode->FirstChildElement("epg_event_oid")->FirstChild() != NULL)
-      {
-        tag->iEpgEventId = atoi(pRecordingNode->FirstChildElement("epg_event_oid")->FirstChild()->Value());
-      }
-      else
-      {
-        // need check for older one offs
-        tag->iEpgEventId = atoi(pRecordingNode->FirstChildElement("epg_event_oid")->FirstChild()->Value());
-      }
-    }
+    // EPG Event ID is not valid on most older recordings
+    tag->iEpgEventId = fields.epgEventOid.ToInt();
   }
 
-  PVR_STRCPY(tag->strRecordingId, pRecordingNode->FirstChildElement("id")->FirstChild()->Value());
-  PVR_STRCPY(tag->strTitle, pRecordingNode->FirstChildElement("name")->FirstChild()->Value());
-  if (pRecordingNode->FirstChildElement("subtitle") != NULL && pRecordingNode->FirstChildElement("subtitle")->FirstChild() != NULL)
+  fields.id.CopyTo(tag->strRecordingId, sizeof(tag->strRecordingId));
+  PVR_STRCPY(tag->strTitle, name.c_str());
+  if (!fields.subtitle.Empty())
   {
     if (g_KodiLook)
     {
-      ParseNextPVRSubtitle(pRecordingNode->FirstChildElement("subtitle")->FirstChild()->Value(), tag);
+      ParseNextPVRSubtitle(fields.subtitle.Text().c_str(), tag);
     }
     else
     {
-      PVR_STRCPY(tag->strTitle, pRecordingNode->FirstChildElement("subtitle")->FirstChild()->Value());
+      fields.subtitle.CopyTo(tag->strTitle, sizeof(tag->strTitle));
     }
   }
 
-  if (pRecordingNode->FirstChildElement("playback_position") != NULL && pRecordingNode->FirstChildElement("playback_position")->FirstChild() != NULL)
-  {
-    tag->iLastPlayedPosition = atoi(pRecordingNode->FirstChildElement("playback_position")->FirstChild()->Value());
-  }
+  tag->iLastPlayedPosition = fields.playbackPosition.ToInt();
 
-  if (pRecordingNode->FirstChildElement("channel_id") != NULL && pRecordingNode->FirstChildElement("channel_id")->FirstChild() != NULL)
+  if (!fields.channelId.Empty())
   {
-    tag->iChannelUid = atoi(pRecordingNode->FirstChildElement("channel_id")->FirstChild()->Value());
+    tag->iChannelUid = fields.channelId.ToInt();
     if (tag->iChannelUid == 0)
     {
       tag->iChannelUid = PVR_CHANNEL_INVALID_UID;
@@ -1159,20 +1390,13 @@ bool cPVRClientNextPVR::UpdatePvrRecording(TiXmlElement* pRecordingNode, PVR_REC
     tag->iChannelUid = PVR_CHANNEL_INVALID_UID;
   }
 
-  if (pRecordingNode->FirstChildElement("file") != NULL && pRecordingNode->FirstChildElement("file")->FirstChild() != NULL)
-  {
-    m_hostFilenames[tag->strRecordingId] = pRecordingNode->FirstChildElement("file")->FirstChild()->Value();
-  }
-  else
-  {
-    m_hostFilenames[tag->strRecordingId] = "";
-  }
   tag->channelType = PVR_RECORDING_CHANNEL_TYPE_UNKNOWN;
   if ( tag->iChannelUid != PVR_CHANNEL_INVALID_UID)
   {
-    if ( m_channelTypes[tag->iChannelUid])
+    bool isRadio;
+    if (m_catalog.IsRadio(tag->iChannelUid, isRadio))
     {
-      if ( m_channelTypes[tag->iChannelUid] == true)
+      if (isRadio)
       {
         tag->channelType = PVR_RECORDING_CHANNEL_TYPE_RADIO;
       }
@@ -1184,39 +1408,102 @@ bool cPVRClientNextPVR::UpdatePvrRecording(TiXmlElement* pRecordingNode, PVR_REC
   }
   if (tag->channelType != PVR_RECORDING_CHANNEL_TYPE_RADIO)
   {
+    char resource[256];
     char artworkPath[512];
+    snprintf(resource, sizeof(resource), "/service?method=recording.artwork&recording_id=%s", tag->strRecordingId);
     snprintf(artworkPath, sizeof(artworkPath), "http://%s:%d/service?method=recording.artwork&sid=%s&recording_id=%s", g_szHostname.c_str(), g_iPort, m_sid, tag->strRecordingId);
-    PVR_STRCPY(tag->strThumbnailPath, artworkPath);
+    PVR_STRCPY(tag->strThumbnailPath, m_artworkCache.GetPath(std::string("recording-") + tag->strRecordingId, resource, artworkPath).c_str());
+    snprintf(resource, sizeof(resource), "/service?method=recording.fanart&recording_id=%s", tag->strRecordingId);
     snprintf(artworkPath, sizeof(artworkPath), "http://%s:%d/service?method=recording.fanart&sid=%s&recording_id=%s", g_szHostname.c_str(), g_iPort, m_sid, tag->strRecordingId);
-    PVR_STRCPY(tag->strFanartPath, artworkPath);
+    PVR_STRCPY(tag->strFanartPath, m_artworkCache.GetPath(std::string("fanart-") + tag->strRecordingId, resource, artworkPath).c_str());
+  }
+  return true;
+}
+
+std::string cPVRClientNextPVR::GetHostFilename(const std::string &recordingId)
+{
+  std::unique_lock<std::mutex> lock(m_recordingsMutex);
+  std::map<std::string, std::string>::const_iterator it = m_hostFilenames.find(recordingId);
+  if (it == m_hostFilenames.end())
+    return "";
+  return it->second;
+}
+
+std::string cPVRClientNextPVR::FindNextEpisode(const PVR_RECORDING &recording)
+{
+  std::vector<seriesEpisode> episodes;
+  {
+    std::unique_lock<std::mutex> lock(m_recordingsMutex);
+    std::map<std::string, std::vector<seriesEpisode>>::iterator it = m_seriesEpisodes.find(recording.strDirectory);
+    if (it == m_seriesEpisodes.end() || it->second.size() < 2)
+      return "";
+    episodes = it->second;
   }
 
+  // season/episode order when all of them have it, recording time otherwise
+  bool numbered = std::all_of(episodes.begin(), episodes.end(), [](const seriesEpisode &e)
+  {
+    return e.season > 0 && e.episode > 0;
+  });
+  std::stable_sort(episodes.begin(), episodes.end(), [numbered](const seriesEpisode &a, const seriesEpisode &b)
+  {
+    if (numbered && (a.season != b.season || a.episode != b.episode))
+    {
+      if (a.season != b.season)
+        return a.season < b.season;
+      return a.episode < b.episode;
+    }
+    return a.recordingTime < b.recordingTime;
+  });
+  for (size_t i = 0; i + 1 < episodes.size(); i++)
+  {
+    if (episodes[i].recordingId == recording.strRecordingId)
+      return episodes[i + 1].recordingId;
+  }
+  return "";
+}
+
+/**
+ * Matches "S01E02 - name", the name being optional. Accepts what the
+ * pattern S(\d\d)E(\d+) - ?(.+)? matched before, without building a regex
+ * for every recording.
+ */
+static bool MatchSeasonEpisode(const char *text, int &season, int &episode, const char *&name)
+{
+  if (text[0] != 'S' || !isdigit((unsigned char) text[1]) || !isdigit((unsigned char) text[2]) || text[3] != 'E' || !isdigit((unsigned char) text[4]))
+    return false;
+  const char *pos = text + 4;
+  int64_t number = 0;
+  while (isdigit((unsigned char) *pos))
+  {
+    if (number < std::numeric_limits<int>::max())
+      number = number * 10 + (*pos - '0');
+    pos++;
+  }
+  if (pos[0] != ' ' || pos[1] != '-')
+    return false;
+  pos += 2;
+  if (*pos == ' ')
+    pos++;
+  // . in the pattern did not match line breaks
+  if (strpbrk(pos, "\r\n") != nullptr)
+    return false;
+  season = (text[1] - '0') * 10 + (text[2] - '0');
+  episode = (int) std::min(number, (int64_t) std::numeric_limits<int>::max());
+  name = pos;
   return true;
 }
 
 void cPVRClientNextPVR::ParseNextPVRSubtitle( const char *episodeName, PVR_RECORDING   *tag)
 {
-    string strEpisodeName =  episodeName;
-    std::regex base_regex("S(\\d\\d)E(\\d+) - ?(.+)?");
-    std::smatch base_match;
-    if (std::regex_match(strEpisodeName , base_match, base_regex))
+    const char *name;
+    if (MatchSeasonEpisode(episodeName, tag->iSeriesNumber, tag->iEpisodeNumber, name))
     {
-      if (base_match.size() == 3 || base_match.size() == 4)
-      {
-        std::ssub_match base_sub_match = base_match[1];
-        tag->iSeriesNumber  = std::stoi(base_sub_match.str());
-        base_sub_match = base_match[2];
-        tag->iEpisodeNumber = std::stoi(base_sub_match.str());
-        if (base_match.size() == 4)
-        {
-          base_sub_match = base_match[3];
-          strcpy(tag->strEpisodeName,base_sub_match.str().c_str());
-        }
-      }
+      PVR_STRCPY(tag->strEpisodeName, name);
     }
     else
     {
-      PVR_STRCPY(tag->strEpisodeName , strEpisodeName.c_str());
+      PVR_STRCPY(tag->strEpisodeName, episodeName);
     }
 }
 
@@ -1287,6 +1574,7 @@ PVR_ERROR cPVRClientNextPVR::GetRecordingEdl(const PVR_RECORDING& recording, PVR
       if (doc.Parse(response.c_str()) != NULL)
       {
         int index = 0;
+        std::vector<std::pair<int, int>> breaks;
         TiXmlElement* commercialsNode = doc.RootElement()->FirstChildElement("commercials");
         TiXmlElement* pCommercialNode;
         for( pCommercialNode = commercialsNode->FirstChildElement("commercial"); pCommercialNode; pCommercialNode=pCommercialNode->NextSiblingElement())
@@ -1296,9 +1584,11 @@ PVR_ERROR cPVRClientNextPVR::GetRecordingEdl(const PVR_RECORDING& recording, PVR
           entry.end = atoi(pCommercialNode->FirstChildElement("end")->FirstChild()->Value()) * 1000 ;
           entry.type = PVR_EDL_TYPE_COMBREAK;
           entries[index] = entry;
+          breaks.push_back(std::make_pair((int) entry.start, (int) entry.end));
           index++;
         }
         *size = index;
+        m_recordingBuffer->SetEdl(recording.strRecordingId, breaks);
         return PVR_ERROR_NO_ERROR;
       }
     }
@@ -1317,13 +1607,19 @@ int cPVRClientNextPVR::GetNumTimers(void)
   if (m_iTimerCount != -1)
     return m_iTimerCount;
 
-  std::string response;
+  std::vector<std::string> resources;
+  std::vector<std::string> responses;
+  std::vector<int> resultCodes;
+  resources.push_back("/service?method=recording.recurring.list");
+  resources.push_back("/service?method=recording.list&filter=pending");
+  NextPVR::m_backEnd->DoRequests(resources, responses, resultCodes);
+
   int timerCount = -1;
   // get list of recurring recordings
-  if (DoRequest("/service?method=recording.recurring.list", response) == HTTP_OK)
+  if (resultCodes[0] == HTTP_OK)
   {
     TiXmlDocument doc;
-    if (doc.Parse(response.c_str()) != NULL)
+    if (doc.Parse(responses[0].c_str()) != NULL)
     {
       TiXmlElement* recordingsNode = doc.RootElement()->FirstChildElement("recurrings");
       if (recordingsNode != NULL)
@@ -1339,11 +1635,10 @@ int cPVRClientNextPVR::GetNumTimers(void)
 
 
   // get list of pending recordings
-  response = "";
-  if (DoRequest("/service?method=recording.list&filter=pending", response) == HTTP_OK)
+  if (resultCodes[1] == HTTP_OK)
   {
     TiXmlDocument doc;
-    if (doc.Parse(response.c_str()) != NULL)
+    if (doc.Parse(responses[1].c_str()) != NULL)
     {
       TiXmlElement* recordingsNode = doc.RootElement()->FirstChildElement("recordings");
       if (recordingsNode != NULL)
@@ -2048,6 +2343,8 @@ PVR_ERROR cPVRClientNextPVR::AddTimer(const PVR_TIMER &timerinfo)
       if (timerinfo.startTime <= time(nullptr) && timerinfo.endTime > time(nullptr))
         PVR->TriggerRecordingUpdate();
       PVR->TriggerTimerUpdate();
+      if (timerinfo.iTimerType == TIMER_REPEATING_KEYWORD && m_bGuideIndex)
+        PreviewKeywordTimer(timerinfo);
       return PVR_ERROR_NO_ERROR;
     }
   }
@@ -2055,6 +2352,47 @@ PVR_ERROR cPVRClientNextPVR::AddTimer(const PVR_TIMER &timerinfo)
   return PVR_ERROR_FAILED;
 }
 
+void cPVRClientNextPVR::PreviewKeywordTimer(const PVR_TIMER &timerinfo)
+{
+  // the backend decides what is recorded, this only counts what the guide held here matches
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  int channelId = timerinfo.iClientChannelUid == PVR_TIMER_ANY_CHANNEL ? -1 : timerinfo.iClientChannelUid;
+  // times of day in minutes, a window ending before it starts runs past midnight
+  bool fromAny = timerinfo.bStartAnyTime || timerinfo.startTime == 0;
+  bool toAny = timerinfo.bEndAnyTime || timerinfo.endTime == 0;
+  struct tm *window = fromAny ? nullptr : localtime(&timerinfo.startTime);
+  int fromMinute = window ? window->tm_hour * 60 + window->tm_min : 0;
+  window = toAny ? nullptr : localtime(&timerinfo.endTime);
+  int toMinute = window ? window->tm_hour * 60 + window->tm_min : 0;
+  unsigned int weekdays = timerinfo.iWeekdays == PVR_WEEKDAY_NONE ? PVR_WEEKDAY_ALLDAYS : timerinfo.iWeekdays;
+  int matches = 0;
+  m_guideIndex.Search(timerinfo.strEpgSearchString, channelId, time(nullptr), std::numeric_limits<time_t>::max(), timerinfo.bFullTextEpgSearch, [&](const NextPVR::guideMatch &match)
+  {
+    struct tm *listing = localtime(&match.start);
+    if (listing == nullptr)
+      return;
+    // PVR_WEEKDAY_MONDAY is the lowest bit, tm_wday counts from Sunday
+    if ((weekdays & (1 << ((listing->tm_wday + 6) % 7))) == 0)
+      return;
+    int minute = listing->tm_hour * 60 + listing->tm_min;
+    if (!fromAny && !toAny)
+    {
+      if (fromMinute < toMinute ? (minute < fromMinute || minute >= toMinute) : (minute < fromMinute && minute >= toMinute))
+        return;
+    }
+    else if ((!fromAny && minute < fromMinute) || (!toAny && minute >= toMinute))
+    {
+      return;
+    }
+    XBMC->Log(LOG_DEBUG, "PreviewKeywordTimer: %d %d %s", match.channelId, (int) match.start, match.title);
+    matches++;
+  });
+  XBMC->Log(LOG_DEBUG, "%s:%d: '%s' matches %d listings, searched in %d us", __FUNCTION__, __LINE__, timerinfo.strEpgSearchString, matches,
+    (int) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+  if (matches > 0)
+    XBMC->QueueNotification(QUEUE_INFO, XBMC->GetLocalizedString(30180), matches);
+}
+
 PVR_ERROR cPVRClientNextPVR::DeleteTimer(const PVR_TIMER &timer, bool bForceDelete)
 {
   char request[512];
@@ -2104,9 +2442,10 @@ bool cPVRClientNextPVR::OpenLiveStream(const PVR_CHANNEL &channelinfo)
   {
     g_NowPlaying = Radio;
   }
-  if (m_liveStreams.count(channelinfo.iUniqueId)!= 0)
+  std::string liveStream = m_catalog.GetLiveStream(channelinfo.iUniqueId);
+  if (!liveStream.empty())
   {
-    snprintf(line,sizeof(line),"%s",m_liveStreams[channelinfo.iUniqueId].c_str());
+    snprintf(line,sizeof(line),"%s",liveStream.c_str());
     m_livePlayer = m_realTimeBuffer;
   }
   else if (channelinfo.bIsRadio == false && m_supportsLiveTimeshift && g_livestreamingmethod == Timeshift)
@@ -2224,8 +2563,15 @@ bool cPVRClientNextPVR::OpenRecordedStream(const PVR_RECORDING &recording)
 
   char line[1024];
   g_NowPlaying = Recording;
-  strcpy(copyRecording.strDirectory,m_hostFilenames[recording.strRecordingId].c_str());
+  PVR_STRCPY(copyRecording.strDirectory, GetHostFilename(recording.strRecordingId).c_str());
   snprintf(line, sizeof(line), "http://%s:%d/live?recording=%s&client=XBMC", g_szHostname.c_str(), g_iPort, recording.strRecordingId);
+  bool preOpenNext;
+  if (!XBMC->GetSetting("preopennext", &preOpenNext))
+  {
+    preOpenNext = false;
+  }
+  m_nextRecordingId = preOpenNext ? FindNextEpisode(recording) : "";
+  m_nextRecordingOpened = false;
   return m_recordingBuffer->Open(line,copyRecording);
 }
 
@@ -2243,6 +2589,18 @@ int cPVRClientNextPVR::ReadRecordedStream(unsigned char *pBuffer, unsigned int i
 {
   LOG_API_CALL(__FUNCTION__);
   iBufferSize = m_recordingBuffer->Read(pBuffer, iBufferSize);
+  if (!m_nextRecordingId.empty() && !m_nextRecordingOpened)
+  {
+    long long length = m_recordingBuffer->Length();
+    if (length > 0 && m_recordingBuffer->Position() > length / 100 * PREOPEN_PERCENT)
+    {
+      // close to the end, get the next episode ready in case Kodi plays it
+      char line[1024];
+      m_nextRecordingOpened = true;
+      snprintf(line, sizeof(line), "http://%s:%d/live?recording=%s&client=XBMC", g_szHostname.c_str(), g_iPort, m_nextRecordingId.c_str());
+      m_recordingBuffer->PreOpen(m_nextRecordingId, line, GetHostFilename(m_nextRecordingId));
+    }
+  }
   return iBufferSize;
 }
 
@@ -32,7 +32,16 @@
 #include "buffers/TimeshiftBuffer.h"
 #include "buffers/RecordingBuffer.h"
 #include "buffers/RollingFile.h"
+#include "XmlReader.h"
+#include "EpgStore.h"
+#include "GuideIndex.h"
+#include "IconSync.h"
+#include "ChannelCatalog.h"
+#include "ArtworkCache.h"
+#include "WorkerPool.h"
 #include <map>
+#include <mutex>
+#include <chrono>
 
 #define SAFE_DELETE(p)       do { delete (p);     (p)=NULL; } while (0)
 
@@ -72,6 +81,37 @@ typedef enum
   NEXTPVR_LIMIT_10 = 10
 } nextpvr_recordinglimit_t;
 
+/* fields of a recording.list entry, empty when not sent */
+struct recordingFields
+{
+  NextPVR::XmlView id;
+  NextPVR::XmlView name;
+  NextPVR::XmlView subtitle;
+  NextPVR::XmlView desc;
+  NextPVR::XmlView reason;
+  NextPVR::XmlView status;
+  NextPVR::XmlView startTimeTicks;
+  NextPVR::XmlView durationSeconds;
+  NextPVR::XmlView epgEventOid;
+  NextPVR::XmlView playbackPosition;
+  NextPVR::XmlView channelId;
+  NextPVR::XmlView file;
+};
+
+/**
+ * Recordings converted from one part of a recording.list response, with
+ * what GetRecordings keeps of each when it transfers them
+ */
+struct recordingChunk
+{
+  const char *data;
+  size_t length;
+  std::vector<PVR_RECORDING> tags;
+  std::vector<std::string> hostFilenames;
+  std::vector<bool> ready;
+  bool done;
+};
+
 class cPVRClientNextPVR : P8PLATFORM::CThread
 {
 public:
@@ -117,7 +157,8 @@ public:
   int GetRecordingLastPlayedPosition(const PVR_RECORDING &recording);
   PVR_ERROR GetRecordingEdl(const PVR_RECORDING& recording, PVR_EDL_ENTRY[], int *size);
   PVR_ERROR GetRecordingStreamProperties(const PVR_RECORDING*, PVR_NAMED_VALUE*, unsigned int*);
-  bool UpdatePvrRecording(TiXmlElement* pRecordingNode, PVR_RECORDING *tag);
+  bool UpdatePvrRecording(const recordingFields &fields, PVR_RECORDING *tag);
+  void ParseRecordingChunk(recordingChunk &chunk);
   void ParseNextPVRSubtitle( const char *episodeName, PVR_RECORDING   *tag);
 
   /* Timer handling */
@@ -163,7 +204,6 @@ private:
   bool GetChannel(unsigned int number, PVR_CHANNEL &channeldata);
   bool LoadGenreXML(const std::string &filename);
   int DoRequest(const char *resource, std::string &response);
-  std::string GetChannelIcon(int channelID);
   std::string GetChannelIconFileName(int channelID);
   void Close();
 
@@ -188,7 +228,6 @@ private:
   char                    m_sid[64];
 
   // update these at end of counting loop can be called during action
-  int                     m_iChannelCount = -1;
   int                     m_iRecordingCount = -1;
   int                     m_iTimerCount = -1;
 
@@ -201,12 +240,52 @@ private:
   timeshift::Buffer      *m_realTimeBuffer;
   timeshift::RecordingBuffer *m_recordingBuffer;
 
+  struct seriesEpisode
+  {
+    std::string recordingId;
+    int season;
+    int episode;
+    time_t recordingTime;
+  };
+
+  // host file names by recording id, and completed recordings by title
+  // directory to find the next episode, both replaced whole by GetRecordings
+  std::mutex m_recordingsMutex;
   std::map<std::string, std::string> m_hostFilenames;
-  std::map<int, bool> m_channelTypes;  // returns isRadio
-  std::map<int, std::string> m_liveStreams;
+  std::map<std::string, std::vector<seriesEpisode>> m_seriesEpisodes;
+  std::string m_nextRecordingId;
+  bool m_nextRecordingOpened = false;
+  std::string FindNextEpisode(const PVR_RECORDING &recording);
+  std::string GetHostFilename(const std::string &recordingId);
+  NextPVR::ChannelCatalog m_catalog;
 
   void SendWakeOnLan();
   bool SaveSettings(std::string name, std::string value);
   void LoadLiveStreams();
 
+  /**
+   * Loads the listings of channelIds for the shards starting at shards
+   * into m_epgStore and m_guideIndex, in the order given. Requests run in parallel on the
+   * backend's workers, shards held and still current are not fetched
+   * again.
+   */
+  void LoadShards(const std::vector<int> &channelIds, const std::vector<time_t> &shards, std::vector<int> &loadedChannelIds);
+
+  /**
+   * Runs a guide refresh asked for by GetEpg, on the background thread
+   */
+  void RefreshGuide();
+
+  /**
+   * Tells how many listings of the guide held match a new keyword timer,
+   * within its times and days
+   */
+  void PreviewKeywordTimer(const PVR_TIMER &timerinfo);
+  NextPVR::EpgStore m_epgStore;
+  NextPVR::GuideIndex m_guideIndex;
+  bool m_bGuideIndex;
+  NextPVR::IconSync m_iconSync;
+  NextPVR::ArtworkCache m_artworkCache;
+  NextPVR::WorkerPool m_parseWorkers;
+
 };